@@ -0,0 +1,17 @@
+/* generated by tools/mkasset from assets/ai_wins.png, do not edit */
+/* 2880 bytes of pixels, 176 bytes run length compressed */
+
+#define winner_ai_height 12
+#define winner_ai_color_base 240
+#define winner_ai_color_count 2
+
+static const unsigned short winner_ai_colors[2] = {0x0000, 0x0014};
+
+static const unsigned int winner_ai_data[44] = {
+		0x000b4030, 0xf103f0f2, 0x80f0f0f1, 0xe3f0fff1, 0xf0f106f0, 0xf0f0f1f0, 0xe4f0fff1, 0x02f181f0,
+		0xfff1f0f0, 0x06f0e4f0, 0xf1f0f0f1, 0xfff1f0f0, 0x04f0e4f0, 0xf1f0f0f1, 0xfff180f0, 0xfff0fff0,
+		0xfff0fff0, 0x00f0b7f0, 0x01f080f1, 0xf181f0f1, 0xf181f000, 0xfff1f001, 0x00f0daf0, 0x0cf080f1,
+		0xf0f1f0f1, 0xf1f0f1f0, 0xf0f1f0f0, 0xdaf0fff1, 0xf0f110f0, 0xf0f1f0f1, 0xf1f0f0f1, 0xf0f0f1f0,
+		0xfff1f0f1, 0x0ef0daf0, 0xf0f1f0f1, 0xf0f1f0f1, 0xf1f0f1f0, 0xfff1f0f0, 0x04f0ddf0, 0xf0f1f0f1,
+		0x06f181f0, 0xf0f0f1f0, 0xecf1f0f1, 0x000000f0
+};
@@ -0,0 +1,18 @@
+/* generated by tools/mkasset from assets/you_win.png, do not edit */
+/* 2880 bytes of pixels, 220 bytes run length compressed */
+
+#define winner_user_height 12
+#define winner_user_color_base 240
+#define winner_user_color_count 2
+
+static const unsigned short winner_user_colors[2] = {0x0000, 0x0280};
+
+static const unsigned int winner_user_data[55] = {
+		0x000b4030, 0xf104f0ec, 0xf0f1f0f0, 0xf000f181, 0xf000f181, 0xf0fff181, 0xf105f0d8, 0xf0f1f0f0,
+		0x00f081f1, 0x03f081f1, 0xf1f0f0f1, 0xf0d8f0ff, 0xf0f0f104, 0xf181f0f1, 0xf181f000, 0xf180f000,
+		0xf0d9f0ff, 0xf0f0f103, 0x02f081f1, 0x81f1f0f1, 0xf0f103f0, 0xf0fff1f0, 0xf181f0d8, 0xf181f000,
+		0xf181f000, 0xf0f1f004, 0xf0fff1f0, 0xf0fff0ff, 0xf0fff0ff, 0xf100f0b1, 0xf101f080, 0x00f181f0,
+		0x01f181f0, 0xf0fff1f0, 0xf100f0da, 0xf10cf080, 0xf0f0f1f0, 0xf0f1f0f1, 0xf1f0f1f0, 0xf0daf0ff,
+		0xf1f0f110, 0xf1f0f1f0, 0xf0f1f0f0, 0xf1f0f0f1, 0xf0fff1f0, 0xf10ef0da, 0xf1f0f1f0, 0xf0f0f1f0,
+		0xf0f1f0f1, 0xf0fff1f0, 0xf104f0dd, 0xf0f0f1f0, 0xf006f181, 0xf1f0f0f1, 0xf0ecf1f0
+};
@@ -1,34 +1,146 @@
+/* the training environment in pong_env.c builds this file into its own
+ * object, where nothing but its pong_env functions should be seen from
+ * outside. everything here is static there, and may go unused */
+#if PONG_ENV
+#define ENV_STATIC static __attribute__((unused))
+#else
+#define ENV_STATIC
+#endif
+
+/* the victory banners, converted from the pngs in assets by tools/mkasset */
+#include "assets/ai_wins.h"
+#include "assets/you_win.h"
+
 /* the width and height of the screen */
 #define WIDTH 240
 #define HEIGHT 160
 
 /* these identifiers define different bit positions of the display control */
+#define MODE3 0x0003
 #define MODE4 0x0004
+#define MODE5 0x0005
 #define BG2 0x0400
 
+/* the bitmap mode the game draws in is picked at compile time:
+ * 3 - one 240x160 page of direct colors, no read-modify-write but no flipping
+ * 4 - two 240x160 pages of palette indices packed two to a halfword
+ * 5 - two 160x128 pages of direct colors stretched to fill the screen
+ * the game always works in 240x160 coordinates, only the drawing primitives
+ * below know about the page the mode actually has */
+#ifndef DISPLAY_MODE
+#define DISPLAY_MODE 4
+#endif
+
+#if DISPLAY_MODE == 3
+#define DISPLAY_MODE_BITS MODE3
+#define SCREEN_WIDTH 240
+#define SCREEN_HEIGHT 160
+#elif DISPLAY_MODE == 4
+#define DISPLAY_MODE_BITS MODE4
+#define SCREEN_WIDTH 240
+#define SCREEN_HEIGHT 160
+#elif DISPLAY_MODE == 5
+#define DISPLAY_MODE_BITS MODE5
+#define SCREEN_WIDTH 160
+#define SCREEN_HEIGHT 128
+#else
+#error "DISPLAY_MODE must be 3, 4 or 5"
+#endif
+
 /* this bit indicates whether to display the front or the back buffer
  * this allows us to refer to bit 4 of the display_control register */
-#define SHOW_BACK 0x10;
+#define SHOW_BACK 0x10
+
+/* on the hardware the registers and memories below sit at fixed addresses.
+ * anything not built for arm is the host build, where they are plain arrays
+ * so the game can be run and checked on a pc */
+#if defined(__arm__)
+#define PONG_HOST 0
+#define IO_ADDRESS(offset) (0x4000000 + (offset))
+#define PALETTE_ADDRESS 0x5000000
+#define VRAM_ADDRESS(offset) (0x6000000 + (offset))
+#define SRAM_ADDRESS 0xE000000
+#else
+#define PONG_HOST 1
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the button register starts out with nothing pressed */
+ENV_STATIC unsigned int host_io[0x400 / 4] = {[0x130 / 4] = 0x03ff};
+ENV_STATIC unsigned int host_palette[0x400 / 4];
+ENV_STATIC unsigned int host_vram[0x18000 / 4];
+ENV_STATIC unsigned char host_sram[0x10000];
+#define IO_ADDRESS(offset) ((unsigned char*) host_io + (offset))
+#define PALETTE_ADDRESS host_palette
+#define VRAM_ADDRESS(offset) ((unsigned char*) host_vram + (offset))
+#define SRAM_ADDRESS host_sram
+
+/* the training environment in pong_env.c builds this file in without main */
+#ifndef PONG_ENV
+#define PONG_ENV 0
+#endif
+
+/* the host build of the game keeps time the way the hardware would, the
+ * environment steps games on many threads and leaves it out */
+#define HOST_TIMING (!PONG_ENV)
+void host_cost(int cycles, int vram_writes, int palette_writes);
+void host_wait_frame();
+#endif
+
+/* the beam takes this many cycles for a line and draws 160 of the 228 */
+#define CYCLES_PER_LINE 1232
+#define LINES_PER_FRAME 228
+#define CYCLES_PER_FRAME (CYCLES_PER_LINE * LINES_PER_FRAME)
+#define VBLANK_START (160 * CYCLES_PER_LINE)
+
+/* roughly what things cost, in cycles, the game is thumb code running out
+ * of the cartridge so every instruction fetch waits. the host charges them
+ * to move its beam on, and beam racing uses them to guess what fits */
+#define COST_PUT_PIXEL 40
+#define COST_RECT 60
+#define COST_SPAN_HALFWORD 4
+#define COST_COMMAND 30
+#define COST_PALETTE_ENTRY 8
+#define COST_POLL_KEYS 40
+#define COST_GAME_UPDATE 600
+#define COST_UNCOMPRESS_BYTE 12
+#define COST_SRAM_BYTE 20
+
+#if PONG_HOST && HOST_TIMING
+#define HOST_COST(cycles, vram_writes, palette_writes) host_cost(cycles, vram_writes, palette_writes)
+#else
+#define HOST_COST(cycles, vram_writes, palette_writes)
+#endif
 
 /* the screen is simply a pointer into memory at a specific address this
  *  * pointer points to 16-bit colors of which there are 240x160 */
-volatile unsigned short* screen = (volatile unsigned short*) 0x6000000;
+ENV_STATIC volatile unsigned short* screen = (volatile unsigned short*) VRAM_ADDRESS(0);
 
 /* the display control pointer points to the gba graphics register */
-volatile unsigned long* display_control = (volatile unsigned long*) 0x4000000;
+ENV_STATIC volatile unsigned int* display_control = (volatile unsigned int*) IO_ADDRESS(0x000);
 
 /* the address of the color palette used in graphics mode 4 */
-volatile unsigned short* palette = (volatile unsigned short*) 0x5000000;
+ENV_STATIC volatile unsigned short* palette = (volatile unsigned short*) PALETTE_ADDRESS;
+
+/* the background 2 scaling registers, mode 5 uses them to stretch its page
+ * over the whole screen, they are 8.8 fixed point steps through the page for
+ * each screen pixel */
+ENV_STATIC volatile short* bg2_pa = (volatile short*) IO_ADDRESS(0x020);
+ENV_STATIC volatile short* bg2_pb = (volatile short*) IO_ADDRESS(0x022);
+ENV_STATIC volatile short* bg2_pc = (volatile short*) IO_ADDRESS(0x024);
+ENV_STATIC volatile short* bg2_pd = (volatile short*) IO_ADDRESS(0x026);
+#define MODE5_STEP_X ((SCREEN_WIDTH << 8) / WIDTH + 1)
+#define MODE5_STEP_Y ((SCREEN_HEIGHT << 8) / HEIGHT + 1)
 
 /* pointers to the front and back buffers - the front buffer is the start
  * of the screen array and the back buffer is a pointer to the second half */
-volatile unsigned short* front_buffer = (volatile unsigned short*) 0x6000000;
-volatile unsigned short* back_buffer = (volatile unsigned short*)  0x600A000;
+ENV_STATIC volatile unsigned short* front_buffer = (volatile unsigned short*) VRAM_ADDRESS(0);
+ENV_STATIC volatile unsigned short* back_buffer = (volatile unsigned short*) VRAM_ADDRESS(0xA000);
 
 /* the button register holds the bits which indicate whether each button has
  * been pressed - this has got to be volatile as well
  */
-volatile unsigned short* buttons = (volatile unsigned short*) 0x04000130;
+ENV_STATIC volatile unsigned short* buttons = (volatile unsigned short*) IO_ADDRESS(0x130);
 
 /* the bit positions indicate each button - the first bit is for A, second for
  * B, and so on, each constant below can be ANDED into the register to get the
@@ -46,41 +158,139 @@ volatile unsigned short* buttons = (volatile unsigned short*) 0x04000130;
 
 /* the scanline counter is a memory cell which is updated to indicate how
  * much of the screen has been drawn */
-volatile unsigned short* scanline_counter = (volatile unsigned short*) 0x4000006;
-
-/* wait for the screen to be fully drawn so we can do something during vblank */
-void wait_vblank() {
-		/* wait until all 160 lines have been updated */
-		while (*scanline_counter < 160) { }
+ENV_STATIC volatile unsigned short* scanline_counter = (volatile unsigned short*) IO_ADDRESS(0x006);
+
+/* the display status register turns on the blank and counter interrupts,
+ * the upper byte holds the line the counter interrupt fires on */
+ENV_STATIC volatile unsigned short* display_status = (volatile unsigned short*) IO_ADDRESS(0x004);
+#define STAT_VBLANK_IRQ (1 << 3)
+#define STAT_HBLANK_IRQ (1 << 4)
+#define STAT_VCOUNT_IRQ (1 << 5)
+
+/* the interrupt enable, request flags and master enable registers */
+ENV_STATIC volatile unsigned short* interrupt_enable = (volatile unsigned short*) IO_ADDRESS(0x200);
+ENV_STATIC volatile unsigned short* interrupt_flags = (volatile unsigned short*) IO_ADDRESS(0x202);
+ENV_STATIC volatile unsigned short* interrupt_master = (volatile unsigned short*) IO_ADDRESS(0x208);
+#define INT_VBLANK (1 << 0)
+#define INT_HBLANK (1 << 1)
+#define INT_VCOUNT (1 << 2)
+
+/* the color special effects registers, they pick which layers an effect
+ * applies to and how strong it is */
+ENV_STATIC volatile unsigned short* blend_control = (volatile unsigned short*) IO_ADDRESS(0x050);
+ENV_STATIC volatile unsigned short* blend_brightness = (volatile unsigned short*) IO_ADDRESS(0x054);
+#define BLEND_BG2 (1 << 2)
+#define BLEND_BACKDROP (1 << 5)
+#define BLEND_BRIGHTEN (2 << 6)
+#define BLEND_DARKEN (3 << 6)
+#define BLEND_EFFECT (3 << 6)
+
+/* set BEAM_RACE to 1 to draw straight into the visible page just behind the
+ * beam instead of drawing into the back buffer and flipping */
+#ifndef BEAM_RACE
+#define BEAM_RACE 0
+#endif
+
+/* the number of vblanks since power on, counted by the vblank interrupt */
+ENV_STATIC volatile unsigned int frame_count = 0;
+
+/* wait for the next vblank to start, even if the screen is already in
+ * vblank */
+ENV_STATIC void wait_frame() {
+#if PONG_HOST && HOST_TIMING
+		host_wait_frame();
+#else
+		unsigned int frame = frame_count;
+		while (frame_count == frame) { }
+#endif
 }
 
-/* this function checks whether a particular button has been pressed */
-unsigned char button_pressed(unsigned short button) {
-		/* and the button register with the button constant we want */
-		unsigned short pressed = *buttons & button;
+/* the palette manager hands out one index per distinct color, so asking for
+ * the same color twice gives back the same index. colors are kept in
+ * palette_colors and copied into palette memory in vblank only, so the
+ * palette never changes halfway down the screen */
 
-		/* if this value is zero, then it's not pressed */
-		if (pressed == 0) {
-				return 1;
-		} else {
-				return 0;
-		}
-}
+/* the indices from here up belong to the art made by tools/mkasset */
+#define ASSET_COLOR_BASE 240
 
 /* keep track of the next palette index */
-int next_palette_index = 0;
+ENV_STATIC int next_palette_index = 0;
+
+/* a copy of the palette, the direct color modes look pixel colors up here */
+ENV_STATIC unsigned short palette_colors[256];
+
+/* a hash table from colors to indices, each slot holds an index plus one
+ * so that zero can mean empty. it has room for every index below
+ * ASSET_COLOR_BASE with slots to spare, so looking a color up always gets
+ * to an empty slot */
+#define PALETTE_SLOTS 256
+#if PALETTE_SLOTS <= ASSET_COLOR_BASE
+#error "the palette table needs more slots than there are indices to hand out"
+#endif
+ENV_STATIC unsigned char palette_slots[PALETTE_SLOTS];
+
+/* one bit for each index which has changed since the last upload */
+ENV_STATIC volatile unsigned int palette_dirty[256 / 32];
+
+/* change one entry, it shows up after the next vblank */
+ENV_STATIC void set_color(int index, unsigned short color) {
+		palette_colors[index] = color;
+		palette_dirty[index >> 5] |= 1 << (index & 31);
+}
+
+/* copy the changed entries to palette memory, called from the vblank
+ * interrupt */
+ENV_STATIC void palette_upload() {
+		int word, bit;
+		for (word = 0; word < 256 / 32; word++) {
+				unsigned int dirty = palette_dirty[word];
+				palette_dirty[word] = 0;
+				for (bit = 0; dirty; bit++, dirty >>= 1) {
+						if (dirty & 1) {
+								HOST_COST(COST_PALETTE_ENTRY, 0, 1);
+								palette[word * 32 + bit] = palette_colors[word * 32 + bit];
+						}
+				}
+		}
+}
 
 /*
  * function which adds a color to the palette and returns the
  * index to it
  */
-unsigned char add_color(unsigned char r, unsigned char g, unsigned char b) {
+ENV_STATIC unsigned char add_color(unsigned char r, unsigned char g, unsigned char b) {
 		unsigned short color = b << 10;
 		color += g << 5;
 		color += r;
 
+		/* look for the color in the table */
+		int slot = (color ^ (color >> 6) ^ (color >> 12)) & (PALETTE_SLOTS - 1);
+		while (palette_slots[slot]) {
+				if (palette_colors[palette_slots[slot] - 1] == color) {
+						return palette_slots[slot] - 1;
+				}
+				slot = (slot + 1) & (PALETTE_SLOTS - 1);
+		}
+
+		/* if we are out of room, hand back the closest color we have */
+		if (next_palette_index >= ASSET_COLOR_BASE) {
+				int i, best = 0, best_distance = 0x7fffffff;
+				for (i = 0; i < next_palette_index; i++) {
+						int dr = (palette_colors[i] & 0x1f) - r;
+						int dg = ((palette_colors[i] >> 5) & 0x1f) - g;
+						int db = (palette_colors[i] >> 10) - b;
+						int distance = dr*dr + dg*dg + db*db;
+						if (distance < best_distance) {
+								best_distance = distance;
+								best = i;
+						}
+				}
+				return best;
+		}
+
 		/* add the color to the palette */
-		palette[next_palette_index] = color;
+		set_color(next_palette_index, color);
+		palette_slots[slot] = next_palette_index + 1;
 
 		/* increment the index */
 		next_palette_index++;
@@ -89,14 +299,544 @@ unsigned char add_color(unsigned char r, unsigned char g, unsigned char b) {
 		return next_palette_index - 1;
 }
 
+/* fades and flashes are done by the hardware's brightness effect on the
+ * whole screen, so they cost no drawing at all. the vblank interrupt moves
+ * the level one step towards its target every rate frames, 0 is no effect
+ * and 16 is all the way to black or white */
+ENV_STATIC volatile unsigned short fade_effect = 0;
+ENV_STATIC volatile int fade_level = 0;
+ENV_STATIC volatile int fade_target = 0;
+ENV_STATIC volatile int fade_rate = 1;
+ENV_STATIC volatile int fade_counter = 0;
+
+/* start a fade with BLEND_DARKEN or BLEND_BRIGHTEN from one level to
+ * another, taking rate frames for each level */
+ENV_STATIC void fade_start(unsigned short effect, int from, int to, int rate) {
+		fade_effect = effect;
+		fade_rate = rate;
+		fade_counter = 0;
+		fade_target = to;
+		fade_level = from;
+}
+
+/* whether a fade is still going */
+ENV_STATIC unsigned char fade_busy() {
+		return fade_level != fade_target;
+}
+
+/* called from the vblank interrupt, so the effect never changes mid-frame */
+ENV_STATIC void fade_update() {
+		if (fade_level != fade_target && ++fade_counter >= fade_rate) {
+				fade_level += fade_level < fade_target ? 1 : -1;
+				fade_counter = 0;
+		}
+		if (fade_level == 0) {
+				*blend_control = 0;
+		} else {
+				*blend_control = fade_effect | BLEND_BG2 | BLEND_BACKDROP;
+		}
+		*blend_brightness = fade_level;
+}
+
+/* the vblank interrupt reads the button register exactly once per frame and
+ * puts the reading in this queue along with the frame it was taken on, the
+ * game drains it once per loop with poll_keys */
+#define KEY_QUEUE_SIZE 4
+
+struct key_sample {
+		unsigned short keys;
+		unsigned int frame;
+};
+
+ENV_STATIC struct key_sample key_queue[KEY_QUEUE_SIZE];
+ENV_STATIC volatile unsigned int key_head = 0;
+ENV_STATIC volatile unsigned int key_tail = 0;
+
+/* the keys which are down, went down and came up as of the last poll */
+ENV_STATIC unsigned short keys_held = 0;
+ENV_STATIC unsigned short keys_pressed = 0;
+ENV_STATIC unsigned short keys_released = 0;
+
+/* the vblank interrupt, takes the key sample for this frame */
+ENV_STATIC void interrupt_vblank() {
+		frame_count++;
+
+		/* colors changed during the frame go in now the screen is done */
+		palette_upload();
+		fade_update();
+
+		/* the register has a 0 bit for each button that is down */
+		key_queue[key_tail % KEY_QUEUE_SIZE].keys = ~*buttons & 0x03ff;
+		key_queue[key_tail % KEY_QUEUE_SIZE].frame = frame_count;
+		key_tail++;
+
+		*interrupt_flags = INT_VBLANK;
+}
+
+/* the input latency probe measures the frames between pressing up or down
+ * and the first frame the paddle shows up somewhere else, the results can be
+ * read out of memory in the emulator */
+ENV_STATIC unsigned int latency_press_frame = 0;
+ENV_STATIC unsigned char latency_armed = 0;
+ENV_STATIC short latency_last_y = -1;
+ENV_STATIC unsigned int input_latency = 0;
+ENV_STATIC unsigned int input_latency_worst = 0;
+
+/* take all the samples taken since the last poll and work out the edges,
+ * a press and release in between polls is still seen as both. the edges
+ * add up until keys_clear_edges, so a task which had to wait a frame still
+ * sees them */
+ENV_STATIC void poll_keys() {
+		unsigned short held = keys_held;
+		HOST_COST(COST_POLL_KEYS, 0, 0);
+
+		/* if we fell behind, only the newest samples are still in the queue */
+		if (key_tail - key_head > KEY_QUEUE_SIZE) {
+				key_head = key_tail - KEY_QUEUE_SIZE;
+		}
+
+		while (key_head != key_tail) {
+				struct key_sample* sample = &key_queue[key_head % KEY_QUEUE_SIZE];
+				keys_pressed |= sample->keys & ~held;
+				keys_released |= held & ~sample->keys;
+				if ((sample->keys & ~held) & (BUTTON_UP | BUTTON_DOWN)) {
+						latency_press_frame = sample->frame;
+						latency_armed = 1;
+				}
+				held = sample->keys;
+				key_head++;
+		}
+
+		keys_held = held;
+}
+
+/* forget the edges once they have been acted on */
+ENV_STATIC void keys_clear_edges() {
+		keys_pressed = 0;
+		keys_released = 0;
+}
+
+/* tell the latency probe where the user paddle is on the screen, frame is
+ * the vblank just before the first scan which shows it there. both ways of
+ * drawing count the same way, a change in the scan right after the press
+ * is 0 frames */
+ENV_STATIC void latency_shown(short y, unsigned int frame) {
+		if (latency_armed && latency_last_y >= 0 && y != latency_last_y) {
+				input_latency = frame - latency_press_frame;
+				if (input_latency > input_latency_worst) {
+						input_latency_worst = input_latency;
+				}
+				latency_armed = 0;
+		}
+		latency_last_y = y;
+}
+
+#if PONG_HOST && HOST_TIMING
+/* the host has no screen being drawn, so it works out where the beam would
+ * be from a rough cost in cycles of everything the game does. the costs
+ * are charged by HOST_COST in the drawing code and the game loop, the beam
+ * moves on and the vblank interrupt runs when it gets to line 160. each
+ * frame the game spills past line 160 is counted.
+ *
+ * to check the frame budget, build and run the game on the host with:
+ *		cc -O2 -o pong-host pong.c && PONG_FRAMES=3600 ./pong-host
+ * which plays with a fixed input pattern for that many frames, prints what
+ * it found and fails if any frame spilled over or any task frame, counted
+ * from when the tasks start to when the frame is drawn, took more than the
+ * tasks' budgets. with PONG_HASH set to a frames hash in hex it also fails
+ * if the frames shown were any different, the default build gives
+ *		PONG_FRAMES=3600 PONG_HASH=5beb46d7 ./pong-host
+ *
+ * PONG_LOAD takes that many lines off the start of every other frame, as if
+ * something else ran first, so the tasks start late and ones which don't
+ * fit have to wait a frame. the run then also fails if nothing was
+ * deferred, a load of 160 lines leaves less than any task's budget:
+ *		PONG_FRAMES=3600 PONG_LOAD=160 ./pong-host */
+unsigned long long host_cycles = 0;
+
+/* the vblank the game is aiming to get its frame done by */
+unsigned long long host_deadline = VBLANK_START;
+
+/* what has happened since wait_frame last returned */
+unsigned long long host_frame_start = 0;
+unsigned int host_frame_vram = 0;
+unsigned int host_frame_palette = 0;
+int host_in_interrupt = 0;
+
+/* the totals for the report */
+unsigned int host_frames = 0;
+unsigned int host_overruns = 0;
+unsigned long long host_worst_cycles = 0;
+unsigned long long host_vram_writes = 0;
+unsigned long long host_palette_writes = 0;
+unsigned int host_frame_limit = 0;
+unsigned int host_load = 0;
+
+/* when the tasks started this frame and the budgets of the ones which ran,
+ * no budget means none ran */
+unsigned long long host_tasks_start = 0;
+unsigned long long host_tasks_budget = 0;
+unsigned int host_over_budget = 0;
+unsigned long long host_worst_tasks = 0;
+
+/* the brightness effect the hardware applies to a 15 bit color */
+unsigned short blend_color(unsigned short color, unsigned short control, int level) {
+		unsigned short result = 0;
+		int shift;
+		if (level > 16) {
+				level = 16;
+		}
+		for (shift = 0; shift < 15; shift += 5) {
+				int c = (color >> shift) & 0x1f;
+				if ((control & BLEND_EFFECT) == BLEND_BRIGHTEN) {
+						c += ((31 - c) * level) >> 4;
+				} else if ((control & BLEND_EFFECT) == BLEND_DARKEN) {
+						c -= (c * level) >> 4;
+				}
+				result |= c << shift;
+		}
+		return result;
+}
+
+/* a hash of every frame shown so far, as the screen would show it with the
+ * effects applied, to compare runs against a known good one. each frame is
+ * also written out as a ppm image if PONG_EXPORT names a directory */
+unsigned int host_frames_hash = 2166136261u;
+
+void host_capture_frame() {
+		static const char* export_dir = NULL;
+		static int export_checked = 0;
+		volatile unsigned short* page = (*display_control & SHOW_BACK) ? back_buffer : front_buffer;
+		unsigned short control = *blend_control;
+		int level = *blend_brightness & 0x1f;
+		FILE* out = NULL;
+		int row, col;
+
+		if (!export_checked) {
+				export_dir = getenv("PONG_EXPORT");
+				export_checked = 1;
+		}
+		if (export_dir) {
+				char name[512];
+				snprintf(name, sizeof(name), "%s/frame%05u.ppm", export_dir, frame_count);
+				out = fopen(name, "wb");
+				if (out) {
+						fprintf(out, "P6 %d %d 31\n", SCREEN_WIDTH, SCREEN_HEIGHT);
+				}
+		}
+
+		for (row = 0; row < SCREEN_HEIGHT; row++) {
+				for (col = 0; col < SCREEN_WIDTH; col++) {
+						unsigned short color;
+						unsigned short layer = BLEND_BG2;
+#if DISPLAY_MODE == 4
+						unsigned short pair = page[(row * SCREEN_WIDTH + col) >> 1];
+						unsigned char index = (col & 1) ? pair >> 8 : pair & 0xff;
+
+						/* index 0 is see through, the backdrop shows there */
+						if (index == 0) {
+								layer = BLEND_BACKDROP;
+						}
+						color = palette[index];
+#else
+						color = page[row * SCREEN_WIDTH + col];
+#endif
+						if (control & layer) {
+								color = blend_color(color, control, level);
+						}
+						host_frames_hash = (host_frames_hash ^ color) * 16777619u;
+						if (out) {
+								fputc(color & 0x1f, out);
+								fputc((color >> 5) & 0x1f, out);
+								fputc((color >> 10) & 0x1f, out);
+						}
+				}
+		}
+
+		if (out) {
+				fclose(out);
+		}
+}
+
+/* kept by the task scheduler, see below */
+extern unsigned int tasks_deferred;
+
+void host_report() {
+		printf("frames %u, worst frame %llu cycles (%llu lines), %u spilled past line 160\n",
+						host_frames, host_worst_cycles, host_worst_cycles / CYCLES_PER_LINE, host_overruns);
+		printf("frames hash %08x, %u task frames deferred\n", host_frames_hash, tasks_deferred);
+		printf("input latency worst %u frames\n", input_latency_worst);
+		printf("worst task frame %llu lines, %u over budget\n",
+						host_worst_tasks / CYCLES_PER_LINE, host_over_budget);
+		if (host_frames) {
+				printf("per frame %llu vram writes, %llu palette writes\n",
+								host_vram_writes / host_frames, host_palette_writes / host_frames);
+		}
+}
+
+/* the vblank, the buttons follow a fixed pattern since there is no pad */
+void host_vblank() {
+		/* the frame the beam just finished is what the screen showed */
+		host_capture_frame();
+
+		unsigned short held = (frame_count & 64) ? BUTTON_UP : BUTTON_DOWN;
+		*buttons = ~held & 0x03ff;
+		if (*interrupt_master && (*interrupt_enable & INT_VBLANK)) {
+				host_in_interrupt = 1;
+				interrupt_vblank();
+				host_in_interrupt = 0;
+		}
+		if (host_frame_limit && frame_count >= host_frame_limit) {
+				const char* expected = getenv("PONG_HASH");
+				int mismatch = expected && strtoul(expected, NULL, 16) != host_frames_hash;
+				host_report();
+				if (mismatch) {
+						printf("frames hash %08x, expected %s\n", host_frames_hash, expected);
+				}
+				exit(host_overruns || host_over_budget || mismatch || (host_load && !tasks_deferred) ? 1 : 0);
+		}
+}
+
+#if BEAM_RACE
+void interrupt_race();
+#endif
+
+/* the first time after now the beam gets to the start of a line */
+unsigned long long host_next_line(int line) {
+		unsigned long long next = host_cycles - host_cycles % CYCLES_PER_FRAME + line * CYCLES_PER_LINE;
+		return next > host_cycles ? next : next + CYCLES_PER_FRAME;
+}
+
+/* move the beam on, running the vblank interrupt when it gets to line 160
+ * and the counter interrupt when it gets to the line that is set. the time
+ * an interrupt takes holds up the rest */
+void host_cost(int cycles, int vram_writes, int palette_writes) {
+		unsigned long long end = host_cycles + cycles;
+		host_frame_vram += vram_writes;
+		host_frame_palette += palette_writes;
+		while (!host_in_interrupt) {
+				unsigned long long next = host_next_line(160);
+				unsigned long long at;
+#if BEAM_RACE
+				int counter = (*display_status & STAT_VCOUNT_IRQ) && *interrupt_master
+						&& (*interrupt_enable & INT_VCOUNT) && host_next_line(*display_status >> 8) < next;
+				if (counter) {
+						next = host_next_line(*display_status >> 8);
+				}
+#endif
+				if (next > end) {
+						break;
+				}
+				host_cycles = next;
+				*scanline_counter = (host_cycles % CYCLES_PER_FRAME) / CYCLES_PER_LINE;
+				at = host_cycles;
+#if BEAM_RACE
+				if (counter) {
+						host_in_interrupt = 1;
+						interrupt_race();
+						host_in_interrupt = 0;
+				} else {
+						host_vblank();
+				}
+#else
+				host_vblank();
+#endif
+				end += host_cycles - at;
+		}
+		if (end > host_cycles) {
+				host_cycles = end;
+		}
+		*scanline_counter = (host_cycles % CYCLES_PER_FRAME) / CYCLES_PER_LINE;
+}
+
+void host_wait_frame() {
+		unsigned long long next;
+
+		/* the frame limit and the load come from the environment the
+		 * first time */
+		if (!host_frames && getenv("PONG_FRAMES")) {
+				host_frame_limit = atoi(getenv("PONG_FRAMES"));
+		}
+		if (!host_frames && getenv("PONG_LOAD")) {
+				host_load = atoi(getenv("PONG_LOAD"));
+		}
+
+		if (host_cycles >= host_deadline) {
+				host_overruns++;
+		}
+
+		/* the frame's work is done, count it */
+		host_frames++;
+		if (host_cycles - host_frame_start > host_worst_cycles) {
+				host_worst_cycles = host_cycles - host_frame_start;
+		}
+		host_vram_writes += host_frame_vram;
+		host_palette_writes += host_frame_palette;
+
+		/* the tasks' work for the frame is drawn by now too */
+		if (host_tasks_budget) {
+				if (host_cycles - host_tasks_start > host_worst_tasks) {
+						host_worst_tasks = host_cycles - host_tasks_start;
+				}
+				if (host_cycles - host_tasks_start > host_tasks_budget) {
+						host_over_budget++;
+				}
+				host_tasks_budget = 0;
+		}
+
+		/* wait for the beam to get to line 160 again */
+		next = host_cycles - host_cycles % CYCLES_PER_FRAME + VBLANK_START;
+		if (next <= host_cycles) {
+				next += CYCLES_PER_FRAME;
+		}
+		host_cost(next - host_cycles, 0, 0);
+
+		/* the next frame should be done by the start of the next vblank */
+		host_deadline = host_cycles - host_cycles % CYCLES_PER_FRAME + VBLANK_START + CYCLES_PER_FRAME;
+		host_frame_start = host_cycles;
+		host_frame_vram = 0;
+		host_frame_palette = 0;
+
+		if (host_load && (frame_count & 1)) {
+				host_cost(host_load * CYCLES_PER_LINE, 0, 0);
+		}
+}
+#endif
+
+/* set TELEMETRY to 0 to leave out the gameplay event log */
+#ifndef TELEMETRY
+#define TELEMETRY 1
+#endif
+
+/* the kinds of gameplay events the telemetry log keeps */
+#define EVENT_SERVE 1
+#define EVENT_PADDLE_HIT 2
+#define EVENT_WALL_BOUNCE 3
+#define EVENT_SCORE 4
+#define EVENT_MATCH_END 5
+
+/* which side an event happened on */
+#define SIDE_USER 0
+#define SIDE_AI 1
+
+/* where on the paddle a hit landed, the ball goes straight, up or down */
+#define ZONE_STRAIGHT 0
+#define ZONE_UP 1
+#define ZONE_DOWN 2
+
+#if TELEMETRY
+/* each event is one word, the low 16 bits of the frame it happened on, its
+ * kind and one byte about it, so recording one is a single store. the log
+ * lives in the big external work ram and gets copied to the cartridge save
+ * ram when a match ends, tools/teldump turns that into csv. the host build
+ * also writes every event to a file as it happens */
+#define TELEMETRY_SIZE 1024
+
+#if PONG_HOST
+#define EWRAM_DATA
+#else
+#define EWRAM_DATA __attribute__((section(".ewram")))
+#endif
+
+unsigned int telemetry_log[TELEMETRY_SIZE] EWRAM_DATA;
+unsigned int telemetry_count = 0;
+
+/* emulators look for this string to know the cartridge has save ram */
+__attribute__((used)) const char sram_id[] = "SRAM_V113";
+
+/* the save ram starts with this, then the number of events recorded, then
+ * the number kept, then the kept events from oldest to newest */
+#define TELEMETRY_MAGIC 0x4c455450
+
+#if PONG_HOST
+FILE* telemetry_file = NULL;
+#endif
+
+void telemetry_record(unsigned char kind, unsigned char detail) {
+		unsigned int event = (frame_count << 16) | (kind << 8) | detail;
+		telemetry_log[telemetry_count % TELEMETRY_SIZE] = event;
+		telemetry_count++;
+
+#if PONG_HOST
+		/* a streamed file says it has an unknown number of events */
+		if (!telemetry_file) {
+				const char* name = getenv("PONG_TELEMETRY");
+				unsigned int header[3] = {TELEMETRY_MAGIC, 0xffffffff, 0xffffffff};
+				telemetry_file = fopen(name ? name : "telemetry.bin", "wb");
+				if (telemetry_file) {
+						fwrite(header, sizeof(header), 1, telemetry_file);
+				}
+		}
+		if (telemetry_file) {
+				fwrite(&event, sizeof(event), 1, telemetry_file);
+		}
+#endif
+}
+
+/* save ram can only be written a byte at a time */
+void sram_write_word(volatile unsigned char* sram, unsigned int word) {
+		sram[0] = word & 0xff;
+		sram[1] = (word >> 8) & 0xff;
+		sram[2] = (word >> 16) & 0xff;
+		sram[3] = word >> 24;
+		HOST_COST(4 * COST_SRAM_BYTE, 0, 0);
+}
+
+/* copy the log to save ram, done when a match ends */
+void telemetry_flush() {
+		volatile unsigned char* sram = (volatile unsigned char*) SRAM_ADDRESS;
+		unsigned int kept = telemetry_count < TELEMETRY_SIZE ? telemetry_count : TELEMETRY_SIZE;
+		unsigned int i;
+		sram_write_word(sram, TELEMETRY_MAGIC);
+		sram_write_word(sram + 4, telemetry_count);
+		sram_write_word(sram + 8, kept);
+		for (i = 0; i < kept; i++) {
+				sram_write_word(sram + 12 + i*4, telemetry_log[(telemetry_count - kept + i) % TELEMETRY_SIZE]);
+		}
+#if PONG_HOST
+		if (telemetry_file) {
+				fflush(telemetry_file);
+		}
+#endif
+}
+#else
+#define telemetry_record(kind, detail)
+#define telemetry_flush()
+#endif
+
+/* work out from a change of ball direction whether it hit a paddle or a
+ * wall, see ballMovement for the directions */
+ENV_STATIC void telemetry_direction(int before, int after) {
+		int going_right = before == 1 || before == 2 || before == 8;
+		int going_left = before == 4 || before == 5 || before == 6;
+		if (before == after) {
+				return;
+		}
+		if (going_right && (after == 4 || after == 5 || after == 6)) {
+				telemetry_record(EVENT_PADDLE_HIT, (SIDE_USER << 4)
+								| (after == 5 ? ZONE_STRAIGHT : after == 4 ? ZONE_UP : ZONE_DOWN));
+		} else if (going_left && (after == 1 || after == 2 || after == 8)) {
+				telemetry_record(EVENT_PADDLE_HIT, (SIDE_AI << 4)
+								| (after == 1 ? ZONE_STRAIGHT : after == 2 ? ZONE_UP : ZONE_DOWN));
+		} else if (after == 6 || after == 8) {
+				/* it was going up and now goes down */
+				telemetry_record(EVENT_WALL_BOUNCE, 0);
+		} else if (after == 4 || after == 2) {
+				telemetry_record(EVENT_WALL_BOUNCE, 1);
+		}
+}
+
 /* a colored square */
 struct square {
 		unsigned short x, y, size;
 		unsigned char color;
 };
 
+#if DISPLAY_MODE == 4
 /* put a pixel on the screen in mode 4 */
-void put_pixel(volatile unsigned short* buffer, int row, int col, unsigned char color) {
+ENV_STATIC void put_pixel(volatile unsigned short* buffer, int row, int col, unsigned char color) {
+		HOST_COST(COST_PUT_PIXEL, 1, 0);
+
 		/* find the offset which is the regular offset divided by two */
 		unsigned short offset = (row * WIDTH + col) >> 1;
 
@@ -113,54 +853,78 @@ void put_pixel(volatile unsigned short* buffer, int row, int col, unsigned char
 		}
 }
 
-/* draw a square onto the screen */
-void draw_square(volatile unsigned short* buffer, struct square* s) {
-		short row, col;
-		/* for each row of the square */
-		for (row = s->y; row < (s->y + s->size*5); row++) {
-				/* loop through each column of the square */
-				for (col = s->x; col < (s->x + s->size); col++) {
-						/* set the screen location to this color */
-						put_pixel(buffer, row, col, s->color);
+/* fill a rectangle in mode 4, only the odd columns at either edge need a
+ * read-modify-write, everything in between is written two pixels at a time */
+ENV_STATIC void fill_rect(volatile unsigned short* buffer, int row, int col, int width, int height, unsigned char color) {
+		unsigned short pair = (color << 8) | color;
+		int r, c;
+		HOST_COST(COST_RECT + height * (width / 2) * COST_SPAN_HALFWORD, height * (width / 2), 0);
+		for (r = row; r < row + height; r++) {
+				c = col;
+				if ((c & 1) && c < col + width) {
+						put_pixel(buffer, r, c, color);
+						c++;
 				}
-		}
-}
-
-void draw_ball(volatile unsigned short* buffer, struct square* s) {
-		short row, col;
-		/* for each row of the square */
-		for (row = s->y; row < (s->y + s->size); row++) {
-				/* loop through each column of the square */
-				for (col = s->x; col < (s->x + s->size); col++) {
-						/* set the screen location to this color */
-						put_pixel(buffer, row, col, s->color);
+				for (; c + 1 < col + width; c += 2) {
+						buffer[(r * WIDTH + c) >> 1] = pair;
+				}
+				if (c < col + width) {
+						put_pixel(buffer, r, c, color);
 				}
 		}
 }
+#elif DISPLAY_MODE == 3
+/* put a pixel on the screen in mode 3, each pixel is its own halfword so
+ * the color is just written */
+ENV_STATIC void put_pixel(volatile unsigned short* buffer, int row, int col, unsigned char color) {
+		HOST_COST(COST_PUT_PIXEL, 1, 0);
+		buffer[row * SCREEN_WIDTH + col] = palette_colors[color];
+}
 
-void update_screen_ball(volatile unsigned short* buffer, unsigned short color, struct square* s) {
-		short row, col;
-		for (row = s->y - 3; row < (s->y + s->size + 3); row++) {
-				for (col = s->x - 3; col < (s->x + s->size + 3); col++) {
-						put_pixel(buffer, row, col, color);
+/* fill a rectangle in mode 3 */
+ENV_STATIC void fill_rect(volatile unsigned short* buffer, int row, int col, int width, int height, unsigned char color) {
+		unsigned short value = palette_colors[color];
+		int r, c;
+		HOST_COST(COST_RECT + height * width * COST_SPAN_HALFWORD, height * width, 0);
+		for (r = row; r < row + height; r++) {
+				for (c = col; c < col + width; c++) {
+						buffer[r * SCREEN_WIDTH + c] = value;
 				}
 		}
 }
+#elif DISPLAY_MODE == 5
+/* put a pixel on the screen in mode 5, the game's coordinates are shrunk to
+ * the page with the same steps the hardware stretches the page back with */
+ENV_STATIC void put_pixel(volatile unsigned short* buffer, int row, int col, unsigned char color) {
+		HOST_COST(COST_PUT_PIXEL, 1, 0);
+		buffer[((row * MODE5_STEP_Y) >> 8) * SCREEN_WIDTH + ((col * MODE5_STEP_X) >> 8)] = palette_colors[color];
+}
 
-
-
-/* clear the screen right around the square */
-void update_screen(volatile unsigned short* buffer, unsigned short color, struct square* s) {
-		short row, col;
-		for (row = s->y - 3; row < (s->y + s->size*5 + 3); row++) {
-				for (col = s->x - 3; col < (s->x + s->size + 3); col++) {
-						put_pixel(buffer, row, col, color);
+/* fill a rectangle in mode 5, the edges are shrunk once and the page pixels
+ * in between are written directly */
+ENV_STATIC void fill_rect(volatile unsigned short* buffer, int row, int col, int width, int height, unsigned char color) {
+		unsigned short value = palette_colors[color];
+		int top = (row * MODE5_STEP_Y) >> 8;
+		int bottom = ((row + height - 1) * MODE5_STEP_Y >> 8) + 1;
+		int left = (col * MODE5_STEP_X) >> 8;
+		int right = ((col + width - 1) * MODE5_STEP_X >> 8) + 1;
+		int r, c;
+		HOST_COST(COST_RECT + (bottom - top) * (right - left) * COST_SPAN_HALFWORD, (bottom - top) * (right - left), 0);
+		for (r = top; r < bottom; r++) {
+				for (c = left; c < right; c++) {
+						buffer[r * SCREEN_WIDTH + c] = value;
 				}
 		}
 }
+#endif
 
 /* this function takes a video buffer and returns to you the other one */
-volatile unsigned short* flip_buffers(volatile unsigned short* buffer) {
+ENV_STATIC volatile unsigned short* flip_buffers(volatile unsigned short* buffer) {
+#if BEAM_RACE || DISPLAY_MODE == 3
+		/* racing the beam only ever uses the front buffer, and mode 3 only
+		 * has room for one page */
+		return buffer;
+#endif
 		/* if the back buffer is up, return that */
 		if(buffer == front_buffer) {
 				/* clear back buffer bit and return back buffer pointer */
@@ -173,16 +937,446 @@ volatile unsigned short* flip_buffers(volatile unsigned short* buffer) {
 		}
 }
 
-/* handle the buttons which are pressed down */
-void handle_buttons(struct square* s) {
+/* the game doesn't draw while it simulates. each frame it fills a draw list
+ * with commands, and the renderer puts the commands in order from the top
+ * of the screen down and runs them. commands whose rows overlap form a
+ * group and keep the order they were added in, so erasing around an object
+ * always happens before drawing anything on top */
+#define CMD_NONE 0
+#define CMD_RECT 1
+#define CMD_GLYPHS 2
+#define CMD_CLEAR 3
+
+/* marks the command which draws the user paddle, for the latency probe */
+#define CMD_TAG_USER 1
+
+/* one command, a rectangle fill, a run of up to four glyphs from the font
+ * or a clear of the whole page */
+struct draw_cmd {
+		unsigned char op, color, tag;
+		unsigned char row, height;
+		unsigned char col, width;
+
+		/* the glyphs of a run, width is the step from one glyph to the next */
+		char text[4];
+};
+
+/* commands whose rows overlap, drawn together once the beam is past bottom */
+struct draw_group {
+		short top, bottom;
+		unsigned char first, count;
+};
+
+#define DRAW_LIST_SIZE 24
+
+struct draw_list {
+		struct draw_cmd cmds[DRAW_LIST_SIZE];
+		int count;
+
+		/* the commands in the order they get run, and their groups */
+		unsigned char order[DRAW_LIST_SIZE];
+		struct draw_group groups[DRAW_LIST_SIZE];
+		int group_count;
+};
+
+/* the glyphs are 5 rows tall and up to 4 wide, the top bit of each row is
+ * the leftmost pixel */
+ENV_STATIC const unsigned char glyph_P[5] = {0xf, 0x9, 0xf, 0x8, 0x8};
+ENV_STATIC const unsigned char glyph_O[5] = {0xf, 0x9, 0x9, 0x9, 0xf};
+ENV_STATIC const unsigned char glyph_N[5] = {0xf, 0x9, 0x9, 0x9, 0x9};
+ENV_STATIC const unsigned char glyph_G[5] = {0xf, 0x8, 0xb, 0x9, 0xf};
+ENV_STATIC const unsigned char glyph_digits[4][5] = {
+		{0xe, 0xa, 0xa, 0xa, 0xe},
+		{0x4, 0x4, 0x4, 0x4, 0x4},
+		{0xe, 0x2, 0xe, 0x8, 0xe},
+		{0xe, 0x2, 0xe, 0x2, 0xe},
+};
+
+ENV_STATIC const unsigned char* glyph_rows(char c) {
+		switch (c) {
+		case 'P': return glyph_P;
+		case 'O': return glyph_O;
+		case 'N': return glyph_N;
+		case 'G': return glyph_G;
+		case '0': case '1': case '2': case '3': return glyph_digits[c - '0'];
+		default: return 0;
+		}
+}
+
+ENV_STATIC void draw_list_begin(struct draw_list* list) {
+		list->count = 0;
+		list->group_count = 0;
+}
+
+/* add a rectangle, clipped to the screen */
+ENV_STATIC void emit_rect(struct draw_list* list, int row, int col, int width, int height, unsigned char color, unsigned char tag) {
+		struct draw_cmd* cmd;
+		if (row < 0) {
+				height += row;
+				row = 0;
+		}
+		if (col < 0) {
+				width += col;
+				col = 0;
+		}
+		if (row + height > HEIGHT) {
+				height = HEIGHT - row;
+		}
+		if (col + width > WIDTH) {
+				width = WIDTH - col;
+		}
+		if (width <= 0 || height <= 0 || list->count == DRAW_LIST_SIZE) {
+				return;
+		}
+		cmd = &list->cmds[list->count++];
+		cmd->op = CMD_RECT;
+		cmd->color = color;
+		cmd->tag = tag;
+		cmd->row = row;
+		cmd->height = height;
+		cmd->col = col;
+		cmd->width = width;
+}
+
+/* add a run of glyphs, step apart */
+ENV_STATIC void emit_glyphs(struct draw_list* list, int row, int col, int step, const char* text, unsigned char color) {
+		struct draw_cmd* cmd;
+		int i;
+		if (list->count == DRAW_LIST_SIZE) {
+				return;
+		}
+		cmd = &list->cmds[list->count++];
+		cmd->op = CMD_GLYPHS;
+		cmd->color = color;
+		cmd->tag = 0;
+		cmd->row = row;
+		cmd->height = 5;
+		cmd->col = col;
+		cmd->width = step;
+		for (i = 0; i < 4; i++) {
+				cmd->text[i] = *text ? *text++ : 0;
+		}
+}
+
+/* add a clear of the whole page */
+ENV_STATIC void emit_clear(struct draw_list* list, unsigned char color) {
+		emit_rect(list, 0, 0, WIDTH, HEIGHT, color, 0);
+		if (list->count) {
+				list->cmds[list->count - 1].op = CMD_CLEAR;
+		}
+}
+
+/* two rectangles of the same color can be merged if together they still
+ * make a rectangle */
+ENV_STATIC int merge_rects(struct draw_cmd* a, struct draw_cmd* b) {
+		if (a->op != CMD_RECT || b->op != CMD_RECT || a->color != b->color || a->tag || b->tag) {
+				return 0;
+		}
+		if (a->col == b->col && a->width == b->width
+						&& b->row <= a->row + a->height && a->row <= b->row + b->height) {
+				int bottom = a->row + a->height > b->row + b->height ? a->row + a->height : b->row + b->height;
+				a->row = a->row < b->row ? a->row : b->row;
+				a->height = bottom - a->row;
+		} else if (a->row == b->row && a->height == b->height
+						&& b->col <= a->col + a->width && a->col <= b->col + b->width) {
+				int right = a->col + a->width > b->col + b->width ? a->col + a->width : b->col + b->width;
+				a->col = a->col < b->col ? a->col : b->col;
+				a->width = right - a->col;
+		} else {
+				return 0;
+		}
+		b->op = CMD_NONE;
+		return 1;
+}
+
+/* sort the commands into groups from the top of the screen down, and merge
+ * what can be merged inside each group */
+ENV_STATIC void draw_list_prepare(struct draw_list* list) {
+		int i, j;
+
+		/* order by top row, keeping the order they came in for equal rows */
+		for (i = 0; i < list->count; i++) {
+				unsigned char index = i;
+				for (j = i; j > 0 && list->cmds[list->order[j - 1]].row > list->cmds[index].row; j--) {
+						list->order[j] = list->order[j - 1];
+				}
+				list->order[j] = index;
+		}
+
+		/* sweep down the screen starting a new group at each gap */
+		list->group_count = 0;
+		for (i = 0; i < list->count; i++) {
+				struct draw_cmd* cmd = &list->cmds[list->order[i]];
+				struct draw_group* group;
+				if (list->group_count > 0 && cmd->row < list->groups[list->group_count - 1].bottom) {
+						group = &list->groups[list->group_count - 1];
+						if (cmd->row + cmd->height > group->bottom) {
+								group->bottom = cmd->row + cmd->height;
+						}
+						group->count++;
+				} else {
+						group = &list->groups[list->group_count++];
+						group->top = cmd->row;
+						group->bottom = cmd->row + cmd->height;
+						group->first = i;
+						group->count = 1;
+				}
+		}
+
+		/* inside a group put things back in the order they came in, then
+		 * merge neighbors */
+		for (i = 0; i < list->group_count; i++) {
+				unsigned char* order = &list->order[list->groups[i].first];
+				int count = list->groups[i].count;
+				int k;
+				for (j = 1; j < count; j++) {
+						unsigned char index = order[j];
+						for (k = j; k > 0 && order[k - 1] > index; k--) {
+								order[k] = order[k - 1];
+						}
+						order[k] = index;
+				}
+				for (j = 1, k = 0; j < count; j++) {
+						if (!merge_rects(&list->cmds[order[k]], &list->cmds[order[j]])) {
+								k = j;
+						}
+				}
+		}
+}
+
+/* the row count commands of a prepared list from first on in running
+ * order draw the user paddle at, or -1 if none of them does. the latency
+ * probe reads it out of the list so drawing never writes anything shared */
+ENV_STATIC short user_row(struct draw_list* list, int first, int count) {
+		int i;
+		for (i = first; i < first + count; i++) {
+				struct draw_cmd* cmd = &list->cmds[list->order[i]];
+				if (cmd->op == CMD_RECT && cmd->tag == CMD_TAG_USER) {
+						return cmd->row;
+				}
+		}
+		return -1;
+}
+
+ENV_STATIC void run_cmd(volatile unsigned short* buffer, struct draw_cmd* cmd) {
+		int i, r, c;
+		HOST_COST(COST_COMMAND, 0, 0);
+		switch (cmd->op) {
+		case CMD_RECT:
+		case CMD_CLEAR:
+				fill_rect(buffer, cmd->row, cmd->col, cmd->width, cmd->height, cmd->color);
+				break;
+		case CMD_GLYPHS:
+				for (i = 0; i < 4 && cmd->text[i]; i++) {
+						const unsigned char* rows = glyph_rows(cmd->text[i]);
+						for (r = 0; rows && r < 5; r++) {
+								for (c = 0; c < 4; c++) {
+										if (rows[r] & (0x8 >> c)) {
+												put_pixel(buffer, cmd->row + r, cmd->col + i*cmd->width + c, cmd->color);
+										}
+								}
+						}
+				}
+				break;
+		}
+}
+
+/* run the commands of one group */
+ENV_STATIC void run_group(volatile unsigned short* buffer, struct draw_list* list, struct draw_group* group) {
+		int i;
+		for (i = 0; i < group->count; i++) {
+				run_cmd(buffer, &list->cmds[list->order[group->first + i]]);
+		}
+}
+
+/* run a prepared list in one pass down the screen */
+ENV_STATIC void draw_list_run(volatile unsigned short* buffer, struct draw_list* list) {
+		int i;
+		for (i = 0; i < list->group_count; i++) {
+				run_group(buffer, list, &list->groups[i]);
+		}
+}
+
+#if BEAM_RACE
+/* in beam racing mode the groups of a draw list are run in the visible page
+ * instead of a back page. right after the game has moved in vblank, each
+ * group that can be done before the beam gets down to it is run there and
+ * then, so it shows on the very next scan. the rest are run by the counter
+ * interrupt once the beam has scanned past all of their rows, so they show
+ * up a scan later without tearing, and groups reaching into the bottom of
+ * the screen are run in the next vblank */
+struct draw_list* race_list;
+volatile int race_next = 0;
+volatile unsigned short* race_buffer;
+
+/* point the counter interrupt at the next group, or turn it off */
+void race_arm() {
+		if (race_next < race_list->group_count && race_list->groups[race_next].bottom < 160) {
+				*display_status = (*display_status & 0x00ff) | STAT_VCOUNT_IRQ
+						| (race_list->groups[race_next].bottom << 8);
+		} else {
+				*display_status &= ~STAT_VCOUNT_IRQ;
+		}
+}
+
+/* a group run in vblank shows on the next scan, one run behind the beam
+ * only on the scan after the next vblank */
+void race_run(struct draw_group* group) {
+		short y = user_row(race_list, group->first, group->count);
+		run_group(race_buffer, race_list, group);
+		if (y >= 0) {
+				latency_shown(y, *scanline_counter < 160 ? frame_count + 1 : frame_count);
+		}
+}
+
+/* a guess at the cycles a group takes to run, on the high side */
+int group_cycles(struct draw_list* list, struct draw_group* group) {
+		int i, cycles = 0;
+		for (i = 0; i < group->count; i++) {
+				struct draw_cmd* cmd = &list->cmds[list->order[group->first + i]];
+				cycles += COST_COMMAND;
+				if (cmd->op == CMD_RECT || cmd->op == CMD_CLEAR) {
+						cycles += COST_RECT + cmd->height * (cmd->width * COST_SPAN_HALFWORD + 2 * COST_PUT_PIXEL);
+				} else if (cmd->op == CMD_GLYPHS) {
+						cycles += 4 * 5 * 4 * COST_PUT_PIXEL;
+				}
+		}
+		return cycles;
+}
+
+/* whether a group can be run now and be done before the beam gets to its
+ * top row, which is only ever true in vblank */
+int race_fits(struct draw_group* group) {
+		int line = *scanline_counter;
+		if (line < 160) {
+				return 0;
+		}
+
+		/* the rest of vblank and the rows above the group, not counting the
+		 * line the beam is partway through */
+		return group_cycles(race_list, group) < (LINES_PER_FRAME - line - 1 + group->top) * CYCLES_PER_LINE;
+}
+
+/* the counter interrupt fires on the line just below the next group */
+void interrupt_race() {
+		while (race_next < race_list->group_count
+						&& race_list->groups[race_next].bottom <= *scanline_counter) {
+				race_run(&race_list->groups[race_next]);
+				race_next++;
+		}
+		race_arm();
+		*interrupt_flags = INT_VCOUNT;
+}
+
+/* run whatever is left over, this must be called in vblank */
+void race_flush() {
+		*display_status &= ~STAT_VCOUNT_IRQ;
+		while (race_list && race_next < race_list->group_count) {
+				race_run(&race_list->groups[race_next]);
+				race_next++;
+		}
+}
+
+/* draw a prepared list, this must be called in vblank after race_flush,
+ * and the list can't change until the next one. the groups from the top
+ * down which fit are run now, the counter interrupt takes the rest */
+void race_queue(volatile unsigned short* buffer, struct draw_list* list) {
+		race_buffer = buffer;
+		race_list = list;
+		race_next = 0;
+		while (race_next < list->group_count && race_fits(&list->groups[race_next])) {
+				race_run(&list->groups[race_next]);
+				race_next++;
+		}
+		race_arm();
+}
+#endif
+
+/* anything which takes more than one frame is written as a task, a function
+ * the scheduler calls once a frame which picks up where it left off the
+ * frame before. the switch in TASK_BEGIN jumps back to the line of the last
+ * TASK_YIELD, so a task keeps nothing on the stack between frames and
+ * whatever it needs later has to live in its struct rather than in locals.
+ * only one TASK_YIELD can go on a line and a task can't use break outside
+ * of its own loops */
+#define TASK_RUNNING 0
+#define TASK_DONE 1
+
+struct task {
+		int (*run)(struct task* t);
+
+		/* the line to pick up at, 0 for the top */
+		int line;
+
+		/* frames to skip before running again */
+		int sleep;
+
+		/* the most cycles one frame of the task takes, including what it
+		 * puts in the draw list. it waits for the next frame if there is
+		 * less than that left before vblank */
+		int budget;
+
+		unsigned char done;
+};
+
+#define TASK_BEGIN(t) switch ((t)->line) { case 0:
+#define TASK_YIELD(t) do { (t)->line = __LINE__; return TASK_RUNNING; case __LINE__:; } while (0)
+#define TASK_SLEEP(t, frames) do { (t)->sleep = (frames); TASK_YIELD(t); } while (0)
+#define TASK_WAIT_UNTIL(t, condition) while (!(condition)) { TASK_YIELD(t); }
+#define TASK_END(t) } (t)->line = 0; return TASK_DONE;
+
+/* how many times a task had to wait for the next frame, for the emulator */
+ENV_STATIC unsigned int tasks_deferred = 0;
+
+/* the cycles left until the next vblank starts, a frame started in vblank
+ * has the whole of the next scan */
+ENV_STATIC int frame_cycles_left() {
+		int lines = 160 - *scanline_counter;
+		if (lines <= 0) {
+				lines += LINES_PER_FRAME;
+		}
+		return lines * CYCLES_PER_LINE;
+}
+
+/* run a frame of each task that is due and fits, the ones first in the
+ * array go first */
+ENV_STATIC void tasks_run(struct task** tasks, int count) {
+		int i;
+#if PONG_HOST && HOST_TIMING
+		host_tasks_start = host_cycles;
+		host_tasks_budget = 0;
+#endif
+		for (i = 0; i < count; i++) {
+				struct task* t = tasks[i];
+				if (t->done) {
+						continue;
+				}
+				if (t->sleep > 0) {
+						t->sleep--;
+						continue;
+				}
+				if (t->budget > frame_cycles_left()) {
+						tasks_deferred++;
+						continue;
+				}
+#if PONG_HOST && HOST_TIMING
+				host_tasks_budget += t->budget;
+#endif
+				HOST_COST(COST_COMMAND, 0, 0);
+				t->done = t->run(t) == TASK_DONE;
+		}
+}
+
+/* handle the buttons which are held down */
+ENV_STATIC void handle_buttons(struct square* s, unsigned short held) {
 		/* move the square with the arrow keys */
-		if (button_pressed(BUTTON_DOWN)) {
+		if (held & BUTTON_DOWN) {
 				if(s->y > 150){
 				}else{
 						s->y += 1;
 				}
 		}
-		if (button_pressed(BUTTON_UP)) {
+		if (held & BUTTON_UP) {
 				if(s->y == 0){
 				}else{
 						s->y -= 1;
@@ -190,19 +1384,8 @@ void handle_buttons(struct square* s) {
 		}
 }
 
-/* clear the screen to black */
-void clear_screen(volatile unsigned short* buffer, unsigned short color) {
-		unsigned short row, col;
-		/* set each pixel black */
-		for (row = 0; row < HEIGHT; row++) {
-				for (col = 0; col < WIDTH; col++) {
-						put_pixel(buffer, row, col, color);
-				}
-		}
-}
-
 /* move up = 1, move down = 0 */
-int AImovement(struct square* s, int move, int ball_direction, struct square* ball){
+ENV_STATIC int AImovement(struct square* s, int move, int ball_direction, struct square* ball){
 		if(ball_direction == 5){
 				if(s->y+4 > ball->y){
 						move = 1;
@@ -239,73 +1422,9 @@ int AImovement(struct square* s, int move, int ball_direction, struct square* ba
 		return move;
 }
 
-/* Display Pong Logo*/
-void DrawPong(volatile unsigned short* buffer, unsigned short color){
-		//'P'
-		put_pixel(buffer, 1, 110, color);
-		put_pixel(buffer, 1, 111, color);
-		put_pixel(buffer, 1, 112, color);
-		put_pixel(buffer, 1, 113, color);
-		put_pixel(buffer, 2, 110, color);
-		put_pixel(buffer, 3, 110, color);
-		put_pixel(buffer, 4, 110, color);
-		put_pixel(buffer, 5, 110, color);
-		put_pixel(buffer, 2, 113, color);
-		put_pixel(buffer, 3, 111, color);
-		put_pixel(buffer, 3, 112, color);
-		put_pixel(buffer, 3, 113, color);
-
-		//'O'
-		put_pixel(buffer, 1, 115, color);
-		put_pixel(buffer, 1, 116, color);
-		put_pixel(buffer, 1, 117, color);
-		put_pixel(buffer, 1, 118, color);
-		put_pixel(buffer, 5, 115, color);
-		put_pixel(buffer, 5, 116, color);
-		put_pixel(buffer, 5, 117, color);
-		put_pixel(buffer, 5, 118, color);
-		put_pixel(buffer, 2, 115, color);
-		put_pixel(buffer, 2, 118, color);
-		put_pixel(buffer, 3, 115, color);
-		put_pixel(buffer, 3, 118, color);
-		put_pixel(buffer, 4, 115, color);
-		put_pixel(buffer, 4, 118, color);
-
-		//'N'
-		put_pixel(buffer, 1, 120, color);
-		put_pixel(buffer, 1, 121, color);
-		put_pixel(buffer, 1, 122, color);
-		put_pixel(buffer, 1, 123, color);	
-		put_pixel(buffer, 2, 120, color);
-		put_pixel(buffer, 2, 123, color);
-		put_pixel(buffer, 3, 120, color);
-		put_pixel(buffer, 3, 123, color);
-		put_pixel(buffer, 4, 120, color);
-		put_pixel(buffer, 4, 123, color);
-		put_pixel(buffer, 5, 120, color);
-		put_pixel(buffer, 5, 123, color);
-
-		//'G'
-		put_pixel(buffer, 1, 125, color);
-		put_pixel(buffer, 1, 126, color);
-		put_pixel(buffer, 1, 127, color);
-		put_pixel(buffer, 1, 128, color);
-		put_pixel(buffer, 2, 125, color);
-		put_pixel(buffer, 3, 125, color);
-		put_pixel(buffer, 3, 127, color);
-		put_pixel(buffer, 3, 128, color);
-		put_pixel(buffer, 4, 125, color);
-		put_pixel(buffer, 4, 128, color);
-		put_pixel(buffer, 5, 125, color);
-		put_pixel(buffer, 5, 126, color);
-		put_pixel(buffer, 5, 127, color);
-		put_pixel(buffer, 5, 128, color);	
-
-}	
-
 //Direction ball is moving
 //1 E, 2 NE, 3 N, 4 NW, 5 W, 6 SW, 7 S, 8 SE
-int ballMovement(struct square* ball, struct square* userPaddle, struct square* AIPaddle, int direction){
+ENV_STATIC int ballMovement(struct square* ball, struct square* userPaddle, struct square* AIPaddle, int direction){
 		//Starts Movement
 		if(direction == 0){
 				direction = 1;
@@ -454,481 +1573,669 @@ int ballMovement(struct square* ball, struct square* userPaddle, struct square*
 		return direction;
 }
 
-//Waits for userpaddle to go either up or down to start
-int startPong(int direction){
+//Waits for up or down to be pressed to start
+ENV_STATIC int startPong(int direction, unsigned short pressed){
 		if(direction == 100){
-				if(button_pressed(BUTTON_DOWN)){
+				if(pressed & BUTTON_DOWN){
 						direction = 1;
 
-				}else if(button_pressed(BUTTON_UP)){
+				}else if(pressed & BUTTON_UP){
 						direction = 1;
 				}
 		}	
 		return direction;
 }
 
-void clear_ball(volatile unsigned short* buffer, unsigned short color, struct square* s) {
-		short row = s->y;
-		short col = s->x;
-		put_pixel(buffer, row, col, color);
-		put_pixel(buffer, row+1, col, color);
-		put_pixel(buffer, row, col+1, color);
-		put_pixel(buffer, row+1, col+1, color);
-}
-
-void drawScore(int anchor, int score, volatile unsigned short* buffer, unsigned short color, unsigned short white){
-		//Clear 3x4 to change AI Score
-		if(anchor == 16){
-				for(int i = 7; i <= 11; i++){
-						for(int j = 115; j <= 117; j++){
-								put_pixel(buffer, i, j, color);
+/* bios calls are made with the swi instruction, the call number goes in a
+ * different place in thumb and arm code */
+#if defined(__thumb__)
+#define SWI(n) "swi " #n
+#else
+#define SWI(n) "swi " #n " << 16"
+#endif
+
+/* the bios decompression header types */
+#define LZ77_TYPE 0x10
+#define RLE_TYPE 0x30
+
+/* decompress data made by tools/mkasset, the bios writes it a halfword at a
+ * time so the destination can be video memory. off the hardware the same
+ * thing is done in C */
+ENV_STATIC void uncompress_vram(const unsigned int* data, volatile unsigned short* dest) {
+#if defined(__arm__)
+		register const unsigned int* r0 asm("r0") = data;
+		register volatile unsigned short* r1 asm("r1") = dest;
+		if ((*data & 0xf0) == LZ77_TYPE) {
+				/* LZ77UnCompVram */
+				asm volatile(SWI(0x12) : "+r"(r0), "+r"(r1) : : "r2", "r3", "memory");
+		} else {
+				/* RLUnCompVram */
+				asm volatile(SWI(0x15) : "+r"(r0), "+r"(r1) : : "r2", "r3", "memory");
+		}
+#else
+		const unsigned char* in = (const unsigned char*) (data + 1);
+		int size = *data >> 8;
+		int written = 0;
+		unsigned short pair = 0;
+		unsigned char out[4096];
+		HOST_COST(size * COST_UNCOMPRESS_BYTE, size / 2, 0);
+		while (written < size) {
+				if ((*data & 0xf0) == LZ77_TYPE) {
+						unsigned char flags = *in++;
+						int block;
+						for (block = 0; block < 8 && written < size; block++) {
+								if (flags & (0x80 >> block)) {
+										int length = (in[0] >> 4) + 3;
+										int distance = (((in[0] & 0x0f) << 8) | in[1]) + 1;
+										in += 2;
+										while (length-- && written < size) {
+												out[written % 4096] = out[(written - distance) % 4096];
+												written++;
+										}
+								} else {
+										out[written++ % 4096] = *in++;
+								}
 						}
-				}
-				//Clear 3x4 to change User Score
-		}else{
-				for(int i = 7; i <= 11; i++){
-						for(int j = 121; j <= 123; j++){
-								put_pixel(buffer, i, j, color);
+				} else {
+						unsigned char flag = *in++;
+						int length;
+						if (flag & 0x80) {
+								for (length = (flag & 0x7f) + 3; length && written < size; length--) {
+										out[written++ % 4096] = *in;
+								}
+								in++;
+						} else {
+								for (length = (flag & 0x7f) + 1; length && written < size; length--) {
+										out[written++ % 4096] = *in++;
+								}
 						}
 				}
-		} 
-		if(anchor == 16){
-				if(score == 1){
-						put_pixel(buffer, 7, 116, white);
-						put_pixel(buffer, 8, 116, white);
-						put_pixel(buffer, 9, 116, white);
-						put_pixel(buffer, 10, 116, white);
-						put_pixel(buffer, 11, 116, white);
-						put_pixel(buffer, 9, 119, white);
-				}else if(score == 2){
-						put_pixel(buffer, 7, 116, white);
-						put_pixel(buffer, 9, 116, white);
-						put_pixel(buffer, 11, 116, white);
-						put_pixel(buffer, 7, 115, white);
-						put_pixel(buffer, 9, 115, white);	
-						put_pixel(buffer, 10, 115, white);
-						put_pixel(buffer, 11, 115, white);
-						put_pixel(buffer, 7, 117, white);
-						put_pixel(buffer, 8, 117, white);
-						put_pixel(buffer, 9, 117, white);
-						put_pixel(buffer, 11, 117, white);
-				}else if(score == 3){
-						put_pixel(buffer, 7, 116, white);
-						put_pixel(buffer, 7, 115, white);
-						put_pixel(buffer, 7, 117, white);
-						put_pixel(buffer, 9, 116, white);
-						put_pixel(buffer, 9, 115, white);
-						put_pixel(buffer, 9, 117, white);
-						put_pixel(buffer, 11, 116, white);
-						put_pixel(buffer, 11, 115, white);
-						put_pixel(buffer, 11, 117, white);
-						put_pixel(buffer, 8, 117, white);
-						put_pixel(buffer, 10, 117, white);
-				}else if(score == 0){
-						put_pixel(buffer, 7, 116, white);
-						put_pixel(buffer, 11, 116, white);
-						put_pixel(buffer, 7, 115, white);
-						put_pixel(buffer, 8, 115, white);
-						put_pixel(buffer, 9, 115, white);
-						put_pixel(buffer, 10, 115, white);
-						put_pixel(buffer, 11, 115, white);	
-						put_pixel(buffer, 7, 117, white);
-						put_pixel(buffer, 8, 117, white);
-						put_pixel(buffer, 9, 117, white);
-						put_pixel(buffer, 10, 117, white);
-						put_pixel(buffer, 11, 117, white);
-				}
-		}else if(anchor == 22){
-				if(score == 1){
-						put_pixel(buffer, 7, 122, white);
-						put_pixel(buffer, 8, 122, white);
-						put_pixel(buffer, 9, 122, white);
-						put_pixel(buffer, 10, 122, white);
-						put_pixel(buffer, 11, 122, white);
-						put_pixel(buffer, 9, 119, white);
-				}else if(score == 2){
-						put_pixel(buffer, 7, 122, white);
-						put_pixel(buffer, 9, 122, white);
-						put_pixel(buffer, 11, 122, white);
-						put_pixel(buffer, 7, 121, white);
-						put_pixel(buffer, 9, 121, white);	
-						put_pixel(buffer, 10, 121, white);
-						put_pixel(buffer, 11, 121, white);
-						put_pixel(buffer, 7, 123, white);
-						put_pixel(buffer, 8, 123, white);
-						put_pixel(buffer, 9, 123, white);
-						put_pixel(buffer, 11, 123, white);
-				}else if(score == 3){
-						put_pixel(buffer, 7, 122, white);
-						put_pixel(buffer, 7, 121, white);
-						put_pixel(buffer, 7, 123, white);
-						put_pixel(buffer, 9, 122, white);
-						put_pixel(buffer, 9, 121, white);
-						put_pixel(buffer, 9, 123, white);
-						put_pixel(buffer, 11, 122, white);
-						put_pixel(buffer, 11, 121, white);
-						put_pixel(buffer, 11, 123, white);
-						put_pixel(buffer, 8, 123, white);
-						put_pixel(buffer, 10, 123, white);
-				}else if(score == 0){
-						put_pixel(buffer, 7, 122, white);
-						put_pixel(buffer, 11, 122, white);
-						put_pixel(buffer, 7, 121, white);
-						put_pixel(buffer, 8, 121, white);
-						put_pixel(buffer, 9, 121, white);
-						put_pixel(buffer, 10, 121, white);
-						put_pixel(buffer, 11, 121, white);	
-						put_pixel(buffer, 7, 123, white);
-						put_pixel(buffer, 8, 123, white);
-						put_pixel(buffer, 9, 123, white);
-						put_pixel(buffer, 10, 123, white);
-						put_pixel(buffer, 11, 123, white);
+
+				/* copy out the halfwords finished so far */
+				for (; pair * 2 + 1 < written; pair++) {
+						dest[pair] = out[(pair * 2) % 4096] | (out[(pair * 2 + 1) % 4096] << 8);
 				}
+		}
+#endif
+}
 
-		}	
+/* a full width strip of mode 4 art made by tools/mkasset from a png, along
+ * with the palette entries it uses */
+struct asset {
+		const unsigned int* data;
+		const unsigned short* colors;
+		unsigned char height, color_base, color_count;
+};
 
-}
+/* the banners shown when the AI or the user wins */
+#define WINNER_ROW 74
+#if winner_ai_color_base < ASSET_COLOR_BASE || winner_user_color_base < ASSET_COLOR_BASE
+#error "the winner banners have to be made with mkasset -b 240 or higher"
+#endif
+ENV_STATIC const struct asset winner_assets[2] = {
+		{winner_ai_data, winner_ai_colors, winner_ai_height, winner_ai_color_base, winner_ai_color_count},
+		{winner_user_data, winner_user_colors, winner_user_height, winner_user_color_base, winner_user_color_count},
+};
 
-void showWinner(int who, volatile unsigned short* buffer){
-		unsigned char red = add_color(20, 0, 0);
-		unsigned char green = add_color(0, 20, 0);
-
-		if(who == 0){
-				//AI
-				put_pixel(buffer, 74, 117, red);
-				put_pixel(buffer, 74, 118, red);
-				put_pixel(buffer, 75, 116, red);
-				put_pixel(buffer, 76, 116, red);
-				put_pixel(buffer, 77, 116, red);
-				put_pixel(buffer, 78, 116, red);
-				put_pixel(buffer, 75, 119, red);
-				put_pixel(buffer, 76, 119, red);
-				put_pixel(buffer, 77, 119, red);
-				put_pixel(buffer, 78, 119, red);
-				put_pixel(buffer, 76, 117, red);
-				put_pixel(buffer, 76, 118, red);
-				put_pixel(buffer, 78, 121, red);
-				put_pixel(buffer, 78, 122, red);
-				put_pixel(buffer, 78, 123, red);
-				put_pixel(buffer, 74, 121, red);
-				put_pixel(buffer, 74, 122, red);
-				put_pixel(buffer, 74, 123, red);
-				put_pixel(buffer, 75, 122, red);
-				put_pixel(buffer, 76, 122, red);
-				put_pixel(buffer, 77, 122, red);
-
-				//Won!
-				//'o'
-				put_pixel(buffer, 81, 120, red);	
-				put_pixel(buffer, 81, 121, red);
-				put_pixel(buffer, 81, 119, red);
-				put_pixel(buffer, 81, 118, red);
-				put_pixel(buffer, 85, 120, red);
-				put_pixel(buffer, 85, 121, red);
-				put_pixel(buffer, 85, 119, red);
-				put_pixel(buffer, 85, 118, red);
-				put_pixel(buffer, 82, 118, red);
-				put_pixel(buffer, 83, 118, red);
-				put_pixel(buffer, 84, 118, red);
-				put_pixel(buffer, 82, 121, red);
-				put_pixel(buffer, 83, 121, red);
-				put_pixel(buffer, 84, 121, red);
-				//'w'
-				put_pixel(buffer, 81, 112, red);
-				put_pixel(buffer, 82, 112, red);
-				put_pixel(buffer, 83, 112, red);
-				put_pixel(buffer, 84, 112, red);
-				put_pixel(buffer, 81, 116, red);
-				put_pixel(buffer, 82, 116, red);
-				put_pixel(buffer, 83, 116, red);
-				put_pixel(buffer, 84, 116, red);
-				put_pixel(buffer, 83, 114, red);
-				put_pixel(buffer, 84, 114, red);
-				put_pixel(buffer, 85, 113, red);
-				put_pixel(buffer, 85, 115, red);
-				//'n'
-				put_pixel(buffer, 81, 123, red);
-				put_pixel(buffer, 81, 124, red);
-				put_pixel(buffer, 81, 125, red);
-				put_pixel(buffer, 81, 126, red);
-				put_pixel(buffer, 82, 123, red);
-				put_pixel(buffer, 83, 123, red);
-				put_pixel(buffer, 84, 123, red);
-				put_pixel(buffer, 85, 123, red);
-				put_pixel(buffer, 82, 126, red);
-				put_pixel(buffer, 83, 126, red);
-				put_pixel(buffer, 84, 126, red);
-				put_pixel(buffer, 85, 126, red);
-				//'!'
-				put_pixel(buffer, 81, 128, red);
-				put_pixel(buffer, 82, 128, red);
-				put_pixel(buffer, 83, 128, red);
-				put_pixel(buffer, 85, 128, red);
-
-		}else{
-				//User
-				//'u'
-				put_pixel(buffer, 74, 111, green);
-				put_pixel(buffer, 75, 111, green);
-				put_pixel(buffer, 76, 111, green);
-				put_pixel(buffer, 77, 111, green);
-				put_pixel(buffer, 78, 111, green);
-				put_pixel(buffer, 74, 114, green);
-				put_pixel(buffer, 75, 114, green);
-				put_pixel(buffer, 76, 114, green);
-				put_pixel(buffer, 77, 114, green);
-				put_pixel(buffer, 78, 114, green);
-				put_pixel(buffer, 78, 112, green);
-				put_pixel(buffer, 78, 113, green);
-				//'s'
-				put_pixel(buffer, 74, 116, green);
-				put_pixel(buffer, 74, 117, green);
-				put_pixel(buffer, 74, 118, green);
-				put_pixel(buffer, 74, 119, green);
-				put_pixel(buffer, 76, 116, green);
-				put_pixel(buffer, 76, 117, green);
-				put_pixel(buffer, 76, 118, green);
-				put_pixel(buffer, 76, 119, green);
-				put_pixel(buffer, 78, 116, green);
-				put_pixel(buffer, 78, 117, green);
-				put_pixel(buffer, 78, 118, green);
-				put_pixel(buffer, 78, 119, green);
-				put_pixel(buffer, 75, 116, green);
-				put_pixel(buffer, 77, 119, green);
-				//'e'
-				put_pixel(buffer, 74, 121, green);
-				put_pixel(buffer, 74, 122, green);
-				put_pixel(buffer, 74, 123, green);
-				put_pixel(buffer, 74, 124, green);	
-				put_pixel(buffer, 76, 121, green);
-				put_pixel(buffer, 76, 122, green);
-				put_pixel(buffer, 76, 123, green);
-				put_pixel(buffer, 76, 124, green);		
-				put_pixel(buffer, 78, 121, green);
-				put_pixel(buffer, 78, 122, green);
-				put_pixel(buffer, 78, 123, green);
-				put_pixel(buffer, 78, 124, green);
-				put_pixel(buffer, 75, 121, green);
-				put_pixel(buffer, 77, 121, green);
-				//'r'
-				put_pixel(buffer, 74, 126, green);
-				put_pixel(buffer, 74, 127, green);
-				put_pixel(buffer, 74, 128, green);
-				put_pixel(buffer, 74, 129, green);
-				put_pixel(buffer, 75, 126, green);
-				put_pixel(buffer, 75, 129, green);
-				put_pixel(buffer, 76, 126, green);
-				put_pixel(buffer, 76, 127, green);
-				put_pixel(buffer, 76, 128, green);
-				put_pixel(buffer, 77, 126, green);
-				put_pixel(buffer, 78, 126, green);
-				put_pixel(buffer, 77, 129, green);
-				put_pixel(buffer, 78, 129, green);
-
-
-
-				//Won!
-				//'o'
-				put_pixel(buffer, 81, 120, green);	
-				put_pixel(buffer, 81, 121, green);
-				put_pixel(buffer, 81, 119, green);
-				put_pixel(buffer, 81, 118, green);
-				put_pixel(buffer, 85, 120, green);
-				put_pixel(buffer, 85, 121, green);
-				put_pixel(buffer, 85, 119, green);
-				put_pixel(buffer, 85, 118, green);
-				put_pixel(buffer, 82, 118, green);
-				put_pixel(buffer, 83, 118, green);
-				put_pixel(buffer, 84, 118, green);
-				put_pixel(buffer, 82, 121, green);
-				put_pixel(buffer, 83, 121, green);
-				put_pixel(buffer, 84, 121, green);
-				//'w'
-				put_pixel(buffer, 81, 112, green);
-				put_pixel(buffer, 82, 112, green);
-				put_pixel(buffer, 83, 112, green);
-				put_pixel(buffer, 84, 112, green);
-				put_pixel(buffer, 81, 116, green);
-				put_pixel(buffer, 82, 116, green);
-				put_pixel(buffer, 83, 116, green);
-				put_pixel(buffer, 84, 116, green);
-				put_pixel(buffer, 83, 114, green);
-				put_pixel(buffer, 84, 114, green);
-				put_pixel(buffer, 85, 113, green);
-				put_pixel(buffer, 85, 115, green);
-				//'n'
-				put_pixel(buffer, 81, 123, green);
-				put_pixel(buffer, 81, 124, green);
-				put_pixel(buffer, 81, 125, green);
-				put_pixel(buffer, 81, 126, green);
-				put_pixel(buffer, 82, 123, green);
-				put_pixel(buffer, 83, 123, green);
-				put_pixel(buffer, 84, 123, green);
-				put_pixel(buffer, 85, 123, green);
-				put_pixel(buffer, 82, 126, green);
-				put_pixel(buffer, 83, 126, green);
-				put_pixel(buffer, 84, 126, green);
-				put_pixel(buffer, 85, 126, green);
-				//'!'
-				put_pixel(buffer, 81, 128, green);
-				put_pixel(buffer, 82, 128, green);
-				put_pixel(buffer, 83, 128, green);
-				put_pixel(buffer, 85, 128, green);
+/* the tallest strip the direct color modes can unpack at once */
+#define ASSET_MAX_HEIGHT 16
 
+/* draw an asset with its top at the given row */
+ENV_STATIC void draw_asset(volatile unsigned short* buffer, int row, const struct asset* a) {
+		int i;
+
+		/* put its colors where its pixels expect them */
+		for (i = 0; i < a->color_count; i++) {
+				set_color(a->color_base + i, a->colors[i]);
 		}
 
+#if DISPLAY_MODE == 4
+		/* the rows of the strip are the rows of the page */
+		uncompress_vram(a->data, &buffer[(row * WIDTH) >> 1]);
+#else
+		/* unpack the indices and look them up a pixel at a time */
+		static unsigned short indices[WIDTH * ASSET_MAX_HEIGHT / 2];
+		int r, c;
+		if (a->height > ASSET_MAX_HEIGHT) {
+				return;
+		}
+		uncompress_vram(a->data, indices);
+		for (r = 0; r < a->height; r++) {
+				for (c = 0; c < WIDTH; c++) {
+						unsigned short pair = indices[(r * WIDTH + c) >> 1];
+						put_pixel(buffer, row + r, c, (c & 1) ? pair >> 8 : pair & 0xff);
+				}
+		}
+#endif
 }
 
-/* the main function */
-int main() {
-		/* we set the mode to mode 4 with bg2 on */
-		*display_control = MODE4 | BG2;
+ENV_STATIC void showWinner(int who, volatile unsigned short* buffer){
+		/* who is 0 for the AI and 1 for the user */
+		draw_asset(buffer, WINNER_ROW, &winner_assets[who]);
+}
 
-		/* make user paddle*/
-		struct square s = {220, 80, 2, add_color(20, 20, 20)};
+/* everything about a game in progress */
+struct game {
+		struct square user, AI, ball;
 
-		/* make AI paddle*/
-		struct square AI = {20,80,2, add_color(20,20,20)};	
+		//AI paddle movement
+		int move;
 
-		/* make ball*/
-		struct square Ball = {120,80,2, add_color(0,10,20)};
+		//Ball movement, 100 while waiting for the serve
+		int direction;
 
-		/* add black to the palette */
-		unsigned char black = add_color(0, 0, 0);
+		int user_score, AI_score;
 
-		/* the buffer we start with */
-		volatile unsigned short* buffer = front_buffer;
+		/* set to 1 when someone gets to 3 */
+		int AI_won, user_won;
+};
 
-		//AI paddle movement
-		int move = 0;
+/* set up a game with the paddles and ball in the middle */
+ENV_STATIC void game_start(struct game* g, unsigned char paddle_color, unsigned char ball_color) {
+		struct square user = {220, 80, 2, paddle_color};
+		struct square AI = {20, 80, 2, paddle_color};
+		struct square ball = {120, 80, 2, ball_color};
+		g->user = user;
+		g->AI = AI;
+		g->ball = ball;
+		g->move = 0;
+		g->direction = 100;
+		g->user_score = 0;
+		g->AI_score = 0;
+		g->AI_won = 0;
+		g->user_won = 0;
+}
 
-		//Ball movement
-		int direction = 100;
+/* what happened in one step of the game */
+#define STEP_PLAY 0
+#define STEP_USER_POINT 1
+#define STEP_AI_POINT 2
+
+/* move the game on by one frame with the given buttons held down, pressed
+ * are the ones which went down since the last frame. this only
+ * touches the game it is given, nothing is drawn. when a point is scored the
+ * ball is put back in the middle, and where it was is left in scored_at so
+ * it can be erased */
+ENV_STATIC int game_update(struct game* g, unsigned short held, unsigned short pressed, struct square* scored_at) {
+		int result = STEP_PLAY;
+		HOST_COST(COST_GAME_UPDATE, 0, 0);
+
+		int before = g->direction;
+		g->direction = startPong(g->direction, pressed);
+		if (before == 100 && g->direction != 100) {
+				telemetry_record(EVENT_SERVE, 0);
+		}
 
-		unsigned char white = add_color(20,20,20);
+		//Ball Movement
+		before = g->direction;
+		g->direction = ballMovement(&g->ball, &g->user, &g->AI, g->direction);
+		telemetry_direction(before, g->direction);
+
+		//Checks if ball hit wall
+		if(g->direction == 101 || g->direction == 102){
+				*scored_at = g->ball;
+				g->ball.x = 120;
+				g->ball.y = 80;
+				if(g->direction == 101){
+						g->user_score += 1;
+						result = STEP_USER_POINT;
+						telemetry_record(EVENT_SCORE, SIDE_USER | (g->user_score << 2) | (g->AI_score << 5));
+				}else{
+						g->AI_score += 1;
+						result = STEP_AI_POINT;
+						telemetry_record(EVENT_SCORE, SIDE_AI | (g->user_score << 2) | (g->AI_score << 5));
+				}
+				g->direction = 100;
+		}
 
-		int User_Score = 0;
-		int AI_Score = 0;
+		//Check to see if anyone has hit 3 for winner
+		if(g->AI_score == 3 && !g->AI_won){
+				g->AI_won = 1;
+				telemetry_record(EVENT_MATCH_END, SIDE_AI);
+				telemetry_flush();
+		}else if(g->user_score == 3 && !g->user_won){
+				g->user_won = 1;
+				telemetry_record(EVENT_MATCH_END, SIDE_USER);
+				telemetry_flush();
+		}
 
-		int AI_Won = 0;
-		int User_Won = 0;
+		//Moving AI Paddle
+		g->move = AImovement(&g->AI, g->move, g->direction, &g->ball);
 
-		/* clear whole screen first */
-		clear_screen(front_buffer, black);
-		clear_screen(back_buffer, black);
+		/* handle button input */
+		handle_buttons(&g->user, held);
 
+		return result;
+}
 
-		/* loop forever */
-		while (1) {
-				if(AI_Won == 1 || User_Won == 1){
-						if(AI_Won == 1){
-								showWinner(0, buffer);
-								/* Wait for vblank before switching buffers */
-								wait_vblank();
-
-								/* Swap the buffers */
-								buffer = flip_buffers(buffer);	
-								AI_Won = 3;
-						}else if(User_Won == 1){
-								showWinner(1, buffer);
-								/* Wait for vblank before switching buffers */
-								wait_vblank();
-
-								/* Swap the buffers */
-								buffer = flip_buffers(buffer);	
-
-								User_Won = 3;
-						}
-				}else if(AI_Won == 3 || User_Won == 3){
+#if PONG_HOST
+/* the event driven simulation, for playing games off the hardware faster
+ * than a frame at a time. most frames nothing happens but the ball and the
+ * paddles moving a pixel, and with the same buttons held down the whole
+ * time where they end up after any number of those frames can be worked
+ * out straight away. only the frames with something in them, the serve, a
+ * bounce, the ball getting to a paddle or past one, go through game_update.
+ * the result is exactly what stepping every frame would give */
+#define FRAMES_FOREVER 0x7fffffff
+
+ENV_STATIC int int_min(int a, int b) {
+		return a < b ? a : b;
+}
 
-				}else{
-						/* Clear the screen - only the areas around the square! */
-						update_screen(buffer, black, &s);
-						update_screen(buffer, black, &AI);
-						update_screen_ball(buffer, black, &Ball);
-
-						direction = startPong(direction);		
-
-						//Display Logo
-						DrawPong(buffer, white);
-
-						/* Draw the paddles */
-						draw_square(buffer, &s);
-						draw_square(buffer, &AI);
-
-						//Draw Ball
-						draw_ball(buffer, &Ball);		
-
-						//Ball Movement
-						direction = ballMovement(&Ball, &s, &AI, direction);	
-
-						//Checks if ball hit wall
-						if(direction == 101){
-								clear_ball(buffer, black, &Ball);
-								Ball.x = 120;
-								Ball.y = 80;
-								direction = 100;
-								User_Score += 1;
-								drawScore(22, User_Score, buffer, black, white);
-								drawScore(16, AI_Score, buffer, black, white);
-								/* Wait for vblank before switching buffers */
-								wait_vblank();
-
-								/* Swap the buffers */
-								buffer = flip_buffers(buffer);	
-
-						}else if(direction == 102){
-								clear_ball(buffer, black, &Ball);
-								Ball.x = 120;
-								Ball.y = 80;
-								direction = 100;
-								AI_Score += 1;
-								drawScore(16, AI_Score, buffer, black, white);
-								drawScore(22, User_Score, buffer, black, white);
-								/* Wait for vblank before switching buffers */
-								wait_vblank();
-
-								/* Swap the buffers */
-								buffer = flip_buffers(buffer);	
+ENV_STATIC int int_max(int a, int b) {
+		return a > b ? a : b;
+}
 
-						}
+/* the frames until the ball next needs game_update, which is once it gets
+ * to the line of the paddle it is heading for, to the goal or to a wall */
+ENV_STATIC int game_quiet_frames(struct game* g, unsigned short pressed) {
+		int x = g->ball.x, y = g->ball.y;
+		int quiet = FRAMES_FOREVER;
+		int plane;
+
+		switch (g->direction) {
+		case 100:
+				/* nothing happens until the user serves */
+				return (pressed & (BUTTON_UP | BUTTON_DOWN)) ? 0 : FRAMES_FOREVER;
+		case 1:
+		case 2:
+		case 8:
+				plane = g->user.x - 1;
+				if (x <= plane) {
+						quiet = plane - x;
+				}
+				quiet = int_min(quiet, int_max((g->direction == 1 ? 236 : 235) - x, 0));
+				break;
+		case 4:
+		case 5:
+		case 6:
+				plane = g->AI.x + 1;
+				if (x >= plane) {
+						quiet = x - plane;
+				}
+				quiet = int_min(quiet, int_max(x - 1, 0));
+				break;
+		default:
+				return 0;
+		}
+
+		if (g->direction == 2) {
+				quiet = int_min(quiet, int_max(y, 0));
+		} else if (g->direction == 8) {
+				quiet = int_min(quiet, int_max(159 - y, 0));
+		} else if (g->direction == 4) {
+				quiet = int_min(quiet, y);
+		} else if (g->direction == 6) {
+				quiet = int_min(quiet, int_max(160 - y, 0));
+		}
+		return quiet;
+}
 
-						//Check to see if anyone has hit 3 for winner
-						if(AI_Score == 3){
-								AI_Won = 1;
-						}else if(User_Score == 3){
-								User_Won = 1;
+/* where handle_buttons leaves the paddle after some frames */
+ENV_STATIC int paddle_after(int y, unsigned short held, int frames) {
+		if ((held & BUTTON_DOWN) && (held & BUTTON_UP)) {
+				/* down then up cancel out, except at the bottom */
+				return y > 150 ? y - 1 : y;
+		} else if (held & BUTTON_DOWN) {
+				return y > 150 ? y : int_min(y + frames, 151);
+		} else if (held & BUTTON_UP) {
+				return int_max(y - frames, 0);
+		}
+		return y;
+}
+
+/* the AI paddle while the ball goes away from it, it goes up and down
+ * between 0 and 151 all the time. as a point on the way round the trip
+ * takes 302 frames, going down is the first half */
+ENV_STATIC void AI_patrol(struct square* s, int* move, int frames) {
+		int trip = (*move == 0 ? s->y : 302 - s->y) % 302;
+		trip = (int) ((trip + (long long) frames) % 302);
+		s->y = trip <= 151 ? trip : 302 - trip;
+		*move = trip >= 1 && trip <= 151 ? 0 : 1;
+}
+
+/* the AI paddle while the ball comes towards it, moving dy a frame. it
+ * runs up or down for as long as the ball stays on the same side of it,
+ * so the frames go by in runs rather than one at a time */
+ENV_STATIC void AI_chase(struct square* s, int* move, int ball_y, int dy, int frames) {
+		int y = s->y;
+		while (frames > 0) {
+				/* where the ball is against the paddle once it has moved */
+				int r = ball_y + dy - y;
+				int n;
+				if (y > 150 || y == 0) {
+						/* turned around at the edge */
+						*move = y > 150 ? 1 : 0;
+						n = 1;
+				} else if (dy == 0 && frames >= 2 && ((r == 3 && y >= 2) || (r == 4 && y <= 149))) {
+						/* level with the ball it goes up and down a pixel,
+						 * every other frame it is back where it was */
+						*move = r == 3 ? 0 : 1;
+						n = frames & ~1;
+						frames -= n;
+						continue;
+				} else if (r < 4) {
+						/* up until it is level or at the top */
+						*move = 1;
+						n = y;
+						if (dy != -1) {
+								n = int_min(n, (3 - r) / (dy + 1) + 1);
 						}
+				} else {
+						/* down until it is level or at the bottom */
+						*move = 0;
+						n = 151 - y;
+						if (dy != 1) {
+								n = int_min(n, (r - 4) / (1 - dy) + 1);
+						}
+				}
+				n = int_min(n, frames);
+				y += *move ? -n : n;
+				ball_y += n * dy;
+				frames -= n;
+		}
+		s->y = y;
+}
+
+/* move the game on by frames in which nothing happens, no more than
+ * game_quiet_frames says */
+ENV_STATIC void game_skip(struct game* g, unsigned short held, int frames) {
+		int dx = 0, dy = 0;
+		if (g->direction == 1 || g->direction == 2 || g->direction == 8) {
+				dx = 1;
+		} else if (g->direction == 4 || g->direction == 5 || g->direction == 6) {
+				dx = -1;
+		}
+		if (g->direction == 2 || g->direction == 4) {
+				dy = -1;
+		} else if (g->direction == 8 || g->direction == 6) {
+				dy = 1;
+		}
+
+		if (dx < 0) {
+				AI_chase(&g->AI, &g->move, g->ball.y, dy, frames);
+		} else {
+				AI_patrol(&g->AI, &g->move, frames);
+		}
+		g->ball.x += dx * frames;
+		g->ball.y += dy * frames;
+		g->user.y = paddle_after(g->user.y, held, frames);
+}
+
+/* move the game on by up to frames frames with the same buttons held down,
+ * like calling game_update that many times with pressed on the first and
+ * nothing pressed after that. it stops early after a point,
+ * and the frames it went through are left in used */
+ENV_STATIC int game_advance(struct game* g, unsigned short held, unsigned short pressed, int frames, struct square* scored_at,
+				int* used) {
+		int result = STEP_PLAY;
+		int done = 0;
+		while (done < frames && result == STEP_PLAY) {
+				int quiet = int_min(game_quiet_frames(g, pressed), frames - done);
+				if (quiet > 0) {
+						game_skip(g, held, quiet);
+						done += quiet;
+				} else {
+						result = game_update(g, held, pressed, scored_at);
+						done++;
+				}
+
+				/* the buttons only went down on the first frame */
+				pressed = 0;
+		}
+		*used = done;
+		return result;
+}
+#endif
+
+/* add a frame of the game as it is after game_update to the draw list,
+ * after whatever is in it already. erasing around where things are now
+ * also covers where they were drawn in the same page two frames ago, since
+ * nothing moves more than a pixel a frame. cleared is where the ball was
+ * when a point was scored, or NULL */
+ENV_STATIC void game_emit(struct draw_list* list, struct game* g, unsigned char black, unsigned char white,
+				const struct square* cleared) {
+		/* take the ball away from where the point was scored */
+		if (cleared) {
+				emit_rect(list, cleared->y, cleared->x, cleared->size, cleared->size, black, 0);
+		}
+
+		/* Clear the screen - only the areas around the square! */
+		emit_rect(list, g->user.y - 3, g->user.x - 3, g->user.size + 6, g->user.size*5 + 6, black, 0);
+		emit_rect(list, g->AI.y - 3, g->AI.x - 3, g->AI.size + 6, g->AI.size*5 + 6, black, 0);
+		emit_rect(list, g->ball.y - 3, g->ball.x - 3, g->ball.size + 6, g->ball.size + 6, black, 0);
+
+		//Display Logo
+		emit_glyphs(list, 1, 110, 5, "PONG", white);
+
+		/* the score shows up once the first point has been scored */
+		if (g->user_score + g->AI_score > 0) {
+				char AI_digit[2] = {'0' + g->AI_score, 0};
+				char user_digit[2] = {'0' + g->user_score, 0};
+				emit_rect(list, 7, 115, 3, 5, black, 0);
+				emit_glyphs(list, 7, 115, 4, AI_digit, white);
+				emit_rect(list, 7, 121, 3, 5, black, 0);
+				emit_glyphs(list, 7, 121, 4, user_digit, white);
+				emit_rect(list, 9, 119, 1, 1, white, 0);
+		}
+
+		/* Draw the paddles */
+		emit_rect(list, g->user.y, g->user.x, g->user.size, g->user.size*5, g->user.color, CMD_TAG_USER);
+		emit_rect(list, g->AI.y, g->AI.x, g->AI.size, g->AI.size*5, g->AI.color, 0);
+
+		//Draw Ball
+		emit_rect(list, g->ball.y, g->ball.x, g->ball.size, g->ball.size, g->ball.color, 0);
+}
+
+#if !PONG_ENV
+/* the frames the serve is held back for after a point, the second frame
+ * of the flash is the first of them */
+#define POINT_PAUSE 32
+
+/* a match from the first serve to the winner being shown, as a task */
+struct match {
+		struct task task;
+		struct game g;
+		unsigned char black, white;
+
+		/* the list the match fills, and the page main draws it into this
+		 * frame. drew is set when the task draws into the page itself */
+		struct draw_list* list;
+		volatile unsigned short* buffer;
+		unsigned char drew;
+
+		/* where the ball was when a point was scored, and for how many
+		 * more frames it still has to be erased */
+		struct square cleared;
+		int clear_frames;
+
+		/* frames left of the pause after a point */
+		int pause;
+};
+
+/* put a frame of the game in the list */
+void match_emit(struct match* m) {
+		game_emit(m->list, &m->g, m->black, m->white, m->clear_frames ? &m->cleared : 0);
+		if (m->clear_frames) {
+				m->clear_frames--;
+		}
+}
+
+int match_run(struct task* t) {
+		struct match* m = (struct match*) t;
+		struct square scored_at;
+		TASK_BEGIN(t);
+
+		while (!m->g.AI_won && !m->g.user_won) {
+				/* move everything first, then draw where it ended up */
+				int result = game_update(&m->g, keys_held, keys_pressed, &scored_at);
+				keys_clear_edges();
+				if (result == STEP_PLAY) {
+						match_emit(m);
+						TASK_YIELD(t);
+						continue;
+				}
+
+				/* flash the screen for the point and put the new score in
+				 * both pages, the ball has to be erased from both too */
+				m->cleared = scored_at;
+				m->clear_frames = 2;
+				fade_start(BLEND_BRIGHTEN, 12, 0, 1);
+				match_emit(m);
+				TASK_YIELD(t);
+
+				/* then hold the serve back for a moment. nothing counts as
+				 * pressed so the ball stays put, but the paddles move */
+				for (m->pause = POINT_PAUSE; m->pause > 0 && !m->g.AI_won && !m->g.user_won; m->pause--) {
+						game_update(&m->g, keys_held, 0, &scored_at);
+						keys_clear_edges();
+						match_emit(m);
+						TASK_YIELD(t);
+				}
+		}
 
+		/* the winning point goes in the other page too */
+		match_emit(m);
+		TASK_YIELD(t);
 
-						//Moving AI Paddle
-						move = AImovement(&AI, move, direction, &Ball);
+		/* let the last flash finish and fade the match out */
+		TASK_WAIT_UNTIL(t, !fade_busy());
+		fade_start(BLEND_DARKEN, 0, 16, 1);
+		TASK_WAIT_UNTIL(t, !fade_busy());
 
-						/* handle button input */
-						handle_buttons(&s);
+		/* put the winner in both pages and fade back in on it */
+		showWinner(m->g.AI_won ? 0 : 1, m->buffer);
+		m->drew = 1;
+		TASK_YIELD(t);
+		showWinner(m->g.AI_won ? 0 : 1, m->buffer);
+		m->drew = 1;
+		fade_start(BLEND_DARKEN, 16, 0, 2);
 
-						/* Wait for vblank before switching buffers */
-						wait_vblank();
+		TASK_END(t);
+}
+
+/* the most a frame of the match takes. copying a full telemetry log to
+ * save ram at the end of the match is around 70 lines, and the winner
+ * banner around 30 in mode 4 where it is unpacked a byte per pixel but
+ * around 120 in modes 3 and 5 where each pixel is a halfword */
+#if DISPLAY_MODE == 4
+#define MATCH_BUDGET (80 * CYCLES_PER_LINE)
+#else
+#define MATCH_BUDGET (130 * CYCLES_PER_LINE)
+#endif
+
+/* the main function */
+int main() {
+		/* we set the mode to the one we were built for with bg2 on */
+		*display_control = DISPLAY_MODE_BITS | BG2;
+#if DISPLAY_MODE == 5
+		/* stretch the small mode 5 page over the whole screen */
+		*bg2_pa = MODE5_STEP_X;
+		*bg2_pb = 0;
+		*bg2_pc = 0;
+		*bg2_pd = MODE5_STEP_Y;
+#endif
+
+		/* the paddles and the logo are white */
+		static struct match match;
+		match.white = add_color(20, 20, 20);
+
+		/* set up the paddles and ball */
+		game_start(&match.g, match.white, add_color(0, 10, 20));
 
-						/* Swap the buffers */
-						buffer = flip_buffers(buffer);				
+		/* add black to the palette */
+		match.black = add_color(0, 0, 0);
+
+		/* the buffer we start with */
+		volatile unsigned short* buffer = front_buffer;
+
+		/* the draw list the tasks fill each frame */
+		static struct draw_list list;
+
+		/* everything that runs from frame to frame */
+		match.task.run = match_run;
+		match.task.budget = MATCH_BUDGET;
+		match.list = &list;
+		struct task* tasks[] = {&match.task};
+
+		/* clear whole screen first */
+		draw_list_begin(&list);
+		emit_clear(&list, match.black);
+		draw_list_prepare(&list);
+		draw_list_run(front_buffer, &list);
+#if DISPLAY_MODE != 3
+		/* mode 3 only has room for the one page */
+		draw_list_run(back_buffer, &list);
+#endif
+
+		/* the vblank interrupt samples the buttons, in beam racing mode the
+		 * counter interrupt gets pointed at the right line each frame by
+		 * race_queue */
+		*display_status |= STAT_VBLANK_IRQ;
+#if BEAM_RACE
+		*interrupt_enable = INT_VBLANK | INT_VCOUNT;
+#else
+		*interrupt_enable = INT_VBLANK;
+#endif
+		*interrupt_master = 1;
+
+		/* start on a whole frame, clearing the pages took part of this one */
+		wait_frame();
+
+		/* loop forever, once a frame */
+		while (1) {
+				/* pick up the buttons sampled in vblank */
+				poll_keys();
+
+				/* let the tasks fill the list or draw */
+				draw_list_begin(&list);
+				match.buffer = buffer;
+				match.drew = 0;
+				tasks_run(tasks, sizeof(tasks) / sizeof(tasks[0]));
+				draw_list_prepare(&list);
+
+#if BEAM_RACE
+				/* what fits is drawn now, the rest behind the beam on
+				 * the next scan */
+				race_queue(buffer, &list);
+				wait_frame();
+				race_flush();
+#else
+				draw_list_run(buffer, &list);
+
+				/* wait for the next vblank, even if this frame started in
+				 * one, so the game moves on once a frame */
+				wait_frame();
+
+				/* Swap the buffers, unless nothing new went in this one */
+				if (list.count || match.drew) {
+						short y = user_row(&list, 0, list.count);
+						buffer = flip_buffers(buffer);
+						if (y >= 0) {
+								latency_shown(y, frame_count);
+						}
 				}
+#endif
 		}
 }
+#endif
 
 /* the game boy advance uses "interrupts" to handle certain situations
- * for now we will ignore these */
-void interrupt_ignore() {
+ * the ones we don't use are ignored */
+ENV_STATIC void interrupt_ignore() {
 		/* do nothing */
 }
 
-/* this table specifies which interrupts we handle which way
- * for now, we ignore all of them */
+/* this table specifies which interrupts we handle which way */
 typedef void (*intrp)();
-const intrp IntrTable[13] = {
-		interrupt_ignore,   /* V Blank interrupt */
+ENV_STATIC const intrp IntrTable[13] = {
+		interrupt_vblank,   /* V Blank interrupt */
 		interrupt_ignore,   /* H Blank interrupt */
+#if BEAM_RACE
+		interrupt_race,     /* V Counter interrupt */
+#else
 		interrupt_ignore,   /* V Counter interrupt */
+#endif
 		interrupt_ignore,   /* Timer 0 interrupt */
 		interrupt_ignore,   /* Timer 1 interrupt */
 		interrupt_ignore,   /* Timer 2 interrupt */
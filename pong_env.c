@@ -0,0 +1,224 @@
+/* the training environment from pong_env.h
+ *
+ * this builds the game itself in, without its main, so the games step with
+ * exactly the same code as the cartridge. build it on the host with:
+ *		cc -O2 -c pong_env.c
+ *
+ * the event log is left out, it is shared by every game */
+#define PONG_ENV 1
+#define TELEMETRY 0
+#include "pong.c"
+#include "pong_env.h"
+
+#if DISPLAY_MODE != 4
+#error "the environment pages are mode 4 pages"
+#endif
+
+struct pong_env {
+		int n;
+		struct game* games;
+		struct pong_observation* observations;
+		signed char* rewards;
+		unsigned char* dones;
+
+		/* the buttons each game held on its last step, a serve needs up or
+		 * down to go down */
+		unsigned short* held;
+
+		/* n pages of mode 4 pixels, or NULL */
+		unsigned short* pages;
+};
+
+/* the palette indices every game draws with, set up by the first create */
+static unsigned char env_white, env_ball, env_black;
+static int env_colors_ready = 0;
+
+/* the page of one game, as the drawing functions want it */
+static volatile unsigned short* env_page(struct pong_env* env, int index) {
+		return env->pages + (long) index * (PONG_PAGE_SIZE / 2);
+}
+
+static void env_observe(struct pong_env* env, int index) {
+		struct game* g = &env->games[index];
+		struct pong_observation* o = &env->observations[index];
+		o->ball_x = g->ball.x;
+		o->ball_y = g->ball.y;
+		o->ball_direction = g->direction;
+		o->user_y = g->user.y;
+		o->AI_y = g->AI.y;
+		o->user_score = g->user_score;
+		o->AI_score = g->AI_score;
+}
+
+static void env_reset_one(struct pong_env* env, int index) {
+		game_start(&env->games[index], env_white, env_ball);
+		env->rewards[index] = 0;
+		env->dones[index] = 0;
+		env->held[index] = 0;
+		if (env->pages) {
+				struct draw_list list;
+				draw_list_begin(&list);
+				emit_clear(&list, env_black);
+				game_emit(&list, &env->games[index], env_black, env_white, 0);
+				draw_list_prepare(&list);
+				draw_list_run(env_page(env, index), &list);
+		}
+		env_observe(env, index);
+}
+
+struct pong_env* pong_env_create(int n, int pixels) {
+		struct pong_env* env = calloc(1, sizeof(struct pong_env));
+		if (!env || n <= 0) {
+				free(env);
+				return NULL;
+		}
+		env->n = n;
+		env->games = calloc(n, sizeof(struct game));
+		env->observations = calloc(n, sizeof(struct pong_observation));
+		env->rewards = calloc(n, sizeof(signed char));
+		env->dones = calloc(n, sizeof(unsigned char));
+		env->held = calloc(n, sizeof(unsigned short));
+		if (pixels) {
+				env->pages = calloc(n, PONG_PAGE_SIZE);
+		}
+		if (!env->games || !env->observations || !env->rewards || !env->dones || !env->held || (pixels && !env->pages)) {
+				pong_env_destroy(env);
+				return NULL;
+		}
+
+		if (!env_colors_ready) {
+				env_white = add_color(20, 20, 20);
+				env_ball = add_color(0, 10, 20);
+				env_black = add_color(0, 0, 0);
+				env_colors_ready = 1;
+		}
+
+		pong_env_reset(env, -1);
+		return env;
+}
+
+void pong_env_destroy(struct pong_env* env) {
+		if (env) {
+				free(env->games);
+				free(env->observations);
+				free(env->rewards);
+				free(env->dones);
+				free(env->held);
+				free(env->pages);
+				free(env);
+		}
+}
+
+void pong_env_reset(struct pong_env* env, int index) {
+		int i;
+		if (index < -1 || index >= env->n) {
+				return;
+		}
+		if (index >= 0) {
+				env_reset_one(env, index);
+				return;
+		}
+		for (i = 0; i < env->n; i++) {
+				env_reset_one(env, i);
+		}
+}
+
+/* hold the action of game i down for up to frames frames, skipping the
+ * frames where nothing happens. it stops early after a point */
+static void env_step_one(struct pong_env* env, int i, unsigned char action, int frames) {
+		struct game* g = &env->games[i];
+		struct game before;
+		struct square scored_at;
+		unsigned short held = 0, pressed;
+		int result, used;
+
+		if (env->dones[i]) {
+				env_reset_one(env, i);
+		}
+
+		if (action == PONG_ACTION_UP) {
+				held = BUTTON_UP;
+		} else if (action == PONG_ACTION_DOWN) {
+				held = BUTTON_DOWN;
+		}
+		pressed = held & ~env->held[i];
+		env->held[i] = held;
+
+		/* where everything was drawn, it may have moved further than
+		 * the game erases around things */
+		before = *g;
+
+		/* one frame goes through game_update just like on the cartridge */
+		if (frames == 1) {
+				result = game_update(g, held, pressed, &scored_at);
+		} else {
+				result = game_advance(g, held, pressed, frames, &scored_at, &used);
+		}
+		env->rewards[i] = result == STEP_USER_POINT ? 1 : result == STEP_AI_POINT ? -1 : 0;
+		env->dones[i] = g->AI_won || g->user_won;
+
+		/* the page is drawn the way the game draws its pages */
+		if (env->pages) {
+				struct draw_list list;
+				draw_list_begin(&list);
+				emit_rect(&list, before.user.y, before.user.x, before.user.size, before.user.size*5, env_black, 0);
+				emit_rect(&list, before.AI.y, before.AI.x, before.AI.size, before.AI.size*5, env_black, 0);
+				emit_rect(&list, before.ball.y, before.ball.x, before.ball.size, before.ball.size, env_black, 0);
+				game_emit(&list, g, env_black, env_white, result != STEP_PLAY ? &scored_at : 0);
+				draw_list_prepare(&list);
+				draw_list_run(env_page(env, i), &list);
+		}
+
+		env_observe(env, i);
+}
+
+void pong_env_step_range(struct pong_env* env, const unsigned char* actions, int first, int count) {
+		int i;
+		if (first < 0) {
+				count += first;
+				first = 0;
+		}
+		for (i = first; i < first + count && i < env->n; i++) {
+				env_step_one(env, i, actions[i], 1);
+		}
+}
+
+void pong_env_step(struct pong_env* env, const unsigned char* actions) {
+		pong_env_step_range(env, actions, 0, env->n);
+}
+
+void pong_env_step_frames_range(struct pong_env* env, const unsigned char* actions, int first, int count,
+				int frames) {
+		int i;
+		if (first < 0) {
+				count += first;
+				first = 0;
+		}
+		for (i = first; i < first + count && i < env->n; i++) {
+				env_step_one(env, i, actions[i], frames);
+		}
+}
+
+void pong_env_step_frames(struct pong_env* env, const unsigned char* actions, int frames) {
+		pong_env_step_frames_range(env, actions, 0, env->n, frames);
+}
+
+const struct pong_observation* pong_env_observations(const struct pong_env* env) {
+		return env->observations;
+}
+
+const unsigned char* pong_env_pages(const struct pong_env* env) {
+		return (const unsigned char*) env->pages;
+}
+
+const unsigned short* pong_env_palette(void) {
+		return palette_colors;
+}
+
+const signed char* pong_env_rewards(const struct pong_env* env) {
+		return env->rewards;
+}
+
+const unsigned char* pong_env_dones(const struct pong_env* env) {
+		return env->dones;
+}
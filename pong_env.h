@@ -0,0 +1,82 @@
+/* a batch of independent pong games for training paddle controllers on the
+ * host against the same AI opponent the game uses
+ *
+ * every game steps exactly like the real one, each step is one frame. all
+ * of the observations, rewards and done flags live in buffers allocated once
+ * by pong_env_create, stepping writes into them in place and never copies
+ * or allocates. different threads may step different games at the same
+ * time with pong_env_step_range or pong_env_step_frames_range */
+#ifndef PONG_ENV_H
+#define PONG_ENV_H
+
+/* what the user paddle does for one frame. like the buttons, up or down
+ * only serves on the step it goes down, after a step with another action */
+#define PONG_ACTION_STAY 0
+#define PONG_ACTION_UP 1
+#define PONG_ACTION_DOWN 2
+
+/* the pages are 240x160 mode 4 screens, one palette index per byte */
+#define PONG_PAGE_WIDTH 240
+#define PONG_PAGE_HEIGHT 160
+#define PONG_PAGE_SIZE (PONG_PAGE_WIDTH * PONG_PAGE_HEIGHT)
+
+/* the compact state of one game */
+struct pong_observation {
+		short ball_x, ball_y;
+
+		/* the ball direction from ballMovement, 100 while waiting for the
+		 * user to serve by pressing up or down */
+		short ball_direction;
+
+		short user_y, AI_y;
+		short user_score, AI_score;
+};
+
+struct pong_env;
+
+/* make n games, with pixels set each game also gets a page which is drawn
+ * after every step, returns NULL if out of memory */
+struct pong_env* pong_env_create(int n, int pixels);
+
+void pong_env_destroy(struct pong_env* env);
+
+/* start game index over, or all of them for -1, any other index which
+ * is not a game does nothing */
+void pong_env_reset(struct pong_env* env, int index);
+
+/* step every game by one frame with one action each. a game which finished
+ * on the last step starts over first */
+void pong_env_step(struct pong_env* env, const unsigned char* actions);
+
+/* step games first up to first + count, actions are indexed by game. the
+ * part of the range outside the games is left out */
+void pong_env_step_range(struct pong_env* env, const unsigned char* actions, int first, int count);
+
+/* step every game by up to frames frames, each holding its action down the
+ * whole time. a game stops early on a point, so rewards still come one at
+ * a time. the frames where nothing but moving happens are skipped over in
+ * one go, so long holds cost about as much as a single step, and the games
+ * end up exactly as they would after as many calls to pong_env_step */
+void pong_env_step_frames(struct pong_env* env, const unsigned char* actions, int frames);
+
+/* the same for games first up to first + count */
+void pong_env_step_frames_range(struct pong_env* env, const unsigned char* actions, int first, int count,
+				int frames);
+
+/* one observation per game */
+const struct pong_observation* pong_env_observations(const struct pong_env* env);
+
+/* one page per game, one after the other, NULL without pixels */
+const unsigned char* pong_env_pages(const struct pong_env* env);
+
+/* the colors of the palette indices in the pages, 15 bit blue-green-red */
+const unsigned short* pong_env_palette(void);
+
+/* the reward of the last step for each game, 1 when the user scored, -1
+ * when the AI did */
+const signed char* pong_env_rewards(const struct pong_env* env);
+
+/* 1 for each game whose match ended on the last step */
+const unsigned char* pong_env_dones(const struct pong_env* env);
+
+#endif
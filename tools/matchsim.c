@@ -0,0 +1,117 @@
+/* matchsim - plays whole matches off the hardware both a frame at a time
+ * and with the event driven simulation, checks that the two end up with
+ * exactly the same games and says how long each took
+ *
+ * build it on the host with:
+ *		cc -O2 -o matchsim matchsim.c ../pong_env.c
+ *
+ * and run it as:
+ *		matchsim [games] [hold]
+ *
+ * it goes on until each game has finished a match, games which finish
+ * early start over. the user mostly follows the ball and picks what to do
+ * every hold frames, 30 unless given */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../pong_env.h"
+
+/* the user moves towards the ball most of the time, and does something at
+ * random otherwise so it loses some points */
+unsigned char pick_action(const struct pong_observation* o, unsigned int* seed) {
+		*seed = *seed * 1103515245 + 12345;
+		if (((*seed >> 16) & 3) == 0) {
+				return (*seed >> 18) % 3;
+		}
+		if (o->ball_y > o->user_y + 5) {
+				return PONG_ACTION_DOWN;
+		} else if (o->ball_y < o->user_y + 4) {
+				return PONG_ACTION_UP;
+		}
+		return PONG_ACTION_STAY;
+}
+
+int main(int argc, char** argv) {
+		int games = argc > 1 ? atoi(argv[1]) : 1000;
+		int hold = argc > 2 ? atoi(argv[2]) : 30;
+		struct pong_env* stepped;
+		struct pong_env* events;
+		unsigned char* actions;
+		unsigned char* finished;
+		unsigned int* seeds;
+		unsigned long long frames = 0;
+		clock_t stepped_time = 0, events_time = 0, start;
+		int left, i, f;
+
+		if (games <= 0 || hold <= 0) {
+				fprintf(stderr, "usage: matchsim [games] [hold]\n");
+				return 1;
+		}
+		stepped = pong_env_create(games, 0);
+		events = pong_env_create(games, 0);
+		actions = calloc(games, 1);
+		finished = calloc(games, 1);
+		seeds = calloc(games, sizeof(unsigned int));
+		if (!stepped || !events || !actions || !finished || !seeds) {
+				fprintf(stderr, "matchsim: out of memory\n");
+				return 1;
+		}
+		for (i = 0; i < games; i++) {
+				seeds[i] = i;
+		}
+
+		for (left = games; left > 0; ) {
+				for (i = 0; i < games; i++) {
+						actions[i] = pick_action(&pong_env_observations(events)[i], &seeds[i]);
+				}
+
+				/* a frame at a time, each game stopping on a point */
+				start = clock();
+				for (i = 0; i < games; i++) {
+						for (f = 0; f < hold; f++) {
+								pong_env_step_range(stepped, actions, i, 1);
+								frames++;
+								if (pong_env_rewards(stepped)[i]) {
+										break;
+								}
+						}
+				}
+				stepped_time += clock() - start;
+
+				start = clock();
+				pong_env_step_frames(events, actions, hold);
+				events_time += clock() - start;
+
+				if (memcmp(pong_env_observations(stepped), pong_env_observations(events),
+										games * sizeof(struct pong_observation))
+								|| memcmp(pong_env_rewards(stepped), pong_env_rewards(events), games)
+								|| memcmp(pong_env_dones(stepped), pong_env_dones(events), games)) {
+						fprintf(stderr, "matchsim: the event driven games went differently after %llu frames\n", frames);
+						return 1;
+				}
+
+				for (i = 0; i < games; i++) {
+						if (pong_env_dones(events)[i] && !finished[i]) {
+								finished[i] = 1;
+								left--;
+						}
+				}
+		}
+
+		printf("%d games, %llu frames, the same both ways\n", games, frames);
+		printf("a frame at a time %.3f s, event driven %.3f s", (double) stepped_time / CLOCKS_PER_SEC,
+						(double) events_time / CLOCKS_PER_SEC);
+		if (events_time > 0) {
+				printf(", %.0f times faster", (double) stepped_time / events_time);
+		}
+		printf("\n");
+
+		pong_env_destroy(stepped);
+		pong_env_destroy(events);
+		free(actions);
+		free(finished);
+		free(seeds);
+		return 0;
+}
@@ -0,0 +1,296 @@
+/* mkasset - turns a png into a compressed mode 4 bitmap the game can
+ * decompress straight into video memory with the bios
+ *
+ * build it on the host with:
+ *		cc -O2 -o mkasset mkasset.c -lpng
+ *
+ * and run it as:
+ *		mkasset [-l | -r] [-b base] name image.png image.h
+ *
+ * -l uses lz77 and -r uses run length encoding, without either the smaller
+ * of the two is used. the image has to be 240 pixels wide so its rows line
+ * up with the rows of a page. each distinct color gets a palette index
+ * starting at base, which defaults to 240, and the header holds the colors
+ * the game has to load into those indices */
+#include <png.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* the width of a mode 4 page */
+#define PAGE_WIDTH 240
+
+/* the bios decompression header types */
+#define LZ77_TYPE 0x10
+#define RLE_TYPE 0x30
+
+/* a growable byte buffer for the compressed data */
+struct bytes {
+		unsigned char* data;
+		int size, capacity;
+};
+
+void put_byte(struct bytes* b, unsigned char value) {
+		if (b->size == b->capacity) {
+				b->capacity = b->capacity ? b->capacity * 2 : 256;
+				b->data = realloc(b->data, b->capacity);
+				if (!b->data) {
+						fprintf(stderr, "mkasset: out of memory\n");
+						exit(1);
+				}
+		}
+		b->data[b->size++] = value;
+}
+
+/* every stream starts with its type and the decompressed size */
+void put_header(struct bytes* b, int type, int size) {
+		put_byte(b, type);
+		put_byte(b, size & 0xff);
+		put_byte(b, (size >> 8) & 0xff);
+		put_byte(b, (size >> 16) & 0xff);
+}
+
+/* the bios wants the stream to be a whole number of words */
+void pad_words(struct bytes* b) {
+		while (b->size & 3) {
+				put_byte(b, 0);
+		}
+}
+
+/* lz77 in the bios format, blocks of eight literals or back references with
+ * a flag byte in front. the vram version of the bios call writes a halfword
+ * at a time, so a reference is never allowed to point just one byte back */
+void compress_lz77(const unsigned char* in, int size, struct bytes* out) {
+		int pos = 0;
+		put_header(out, LZ77_TYPE, size);
+		while (pos < size) {
+				int flag_at = out->size;
+				int block;
+				put_byte(out, 0);
+				for (block = 0; block < 8 && pos < size; block++) {
+						int best_length = 0, best_distance = 0;
+						int distance;
+						for (distance = 2; distance <= 4096 && distance <= pos; distance++) {
+								int length = 0;
+								while (length < 18 && pos + length < size
+												&& in[pos + length] == in[pos + length - distance]) {
+										length++;
+								}
+								if (length > best_length) {
+										best_length = length;
+										best_distance = distance;
+								}
+						}
+						if (best_length >= 3) {
+								out->data[flag_at] |= 0x80 >> block;
+								put_byte(out, ((best_length - 3) << 4) | ((best_distance - 1) >> 8));
+								put_byte(out, (best_distance - 1) & 0xff);
+								pos += best_length;
+						} else {
+								put_byte(out, in[pos]);
+								pos++;
+						}
+				}
+		}
+		pad_words(out);
+}
+
+/* run length encoding in the bios format, runs of 3 to 130 of the same byte
+ * or stretches of 1 to 128 bytes copied as they are */
+void compress_rle(const unsigned char* in, int size, struct bytes* out) {
+		int pos = 0;
+		put_header(out, RLE_TYPE, size);
+		while (pos < size) {
+				int run = 1;
+				while (run < 130 && pos + run < size && in[pos + run] == in[pos]) {
+						run++;
+				}
+				if (run >= 3) {
+						put_byte(out, 0x80 | (run - 3));
+						put_byte(out, in[pos]);
+						pos += run;
+				} else {
+						/* copy until the next run of three starts */
+						int length = 0;
+						while (length < 128 && pos + length < size
+										&& !(pos + length + 2 < size
+												&& in[pos + length] == in[pos + length + 1]
+												&& in[pos + length] == in[pos + length + 2])) {
+								length++;
+						}
+						put_byte(out, length - 1);
+						while (length--) {
+								put_byte(out, in[pos++]);
+						}
+				}
+		}
+		pad_words(out);
+}
+
+/* undo either compression, used to check the output before writing it */
+int decompress(const unsigned char* in, unsigned char* out, int size) {
+		int pos = 4, written = 0;
+		if (in[0] == LZ77_TYPE) {
+				while (written < size) {
+						unsigned char flags = in[pos++];
+						int block;
+						for (block = 0; block < 8 && written < size; block++) {
+								if (flags & (0x80 >> block)) {
+										int length = (in[pos] >> 4) + 3;
+										int distance = (((in[pos] & 0x0f) << 8) | in[pos + 1]) + 1;
+										pos += 2;
+										while (length-- && written < size) {
+												out[written] = out[written - distance];
+												written++;
+										}
+								} else {
+										out[written++] = in[pos++];
+								}
+						}
+				}
+		} else {
+				while (written < size) {
+						unsigned char flag = in[pos++];
+						int length;
+						if (flag & 0x80) {
+								length = (flag & 0x7f) + 3;
+								while (length-- && written < size) {
+										out[written++] = in[pos];
+								}
+								pos++;
+						} else {
+								length = (flag & 0x7f) + 1;
+								while (length-- && written < size) {
+										out[written++] = in[pos++];
+								}
+						}
+				}
+		}
+		return written;
+}
+
+/* read a png as 8 bit rgb rows */
+unsigned char* read_png(const char* path, int* width, int* height) {
+		png_image image;
+		unsigned char* pixels;
+		memset(&image, 0, sizeof(image));
+		image.version = PNG_IMAGE_VERSION;
+		if (!png_image_begin_read_from_file(&image, path)) {
+				fprintf(stderr, "mkasset: %s: %s\n", path, image.message);
+				return NULL;
+		}
+		image.format = PNG_FORMAT_RGB;
+		pixels = malloc(PNG_IMAGE_SIZE(image));
+		if (!pixels || !png_image_finish_read(&image, NULL, pixels, 0, NULL)) {
+				fprintf(stderr, "mkasset: %s: %s\n", path, image.message);
+				free(pixels);
+				return NULL;
+		}
+		*width = image.width;
+		*height = image.height;
+		return pixels;
+}
+
+int main(int argc, char** argv) {
+		int type = 0, base = 240;
+		int arg = 1;
+		int width, height, size, i;
+		unsigned char* rgb;
+		unsigned char* indices;
+		unsigned char* check;
+		unsigned short colors[256];
+		int color_count = 0;
+		struct bytes lz77 = {0}, rle = {0};
+		struct bytes* best;
+		const char* name;
+		FILE* out;
+
+		while (arg < argc && argv[arg][0] == '-') {
+				if (!strcmp(argv[arg], "-l")) {
+						type = LZ77_TYPE;
+				} else if (!strcmp(argv[arg], "-r")) {
+						type = RLE_TYPE;
+				} else if (!strcmp(argv[arg], "-b") && arg + 1 < argc) {
+						base = atoi(argv[++arg]);
+				} else {
+						break;
+				}
+				arg++;
+		}
+		if (argc - arg != 3 || base < 0 || base > 255) {
+				fprintf(stderr, "usage: mkasset [-l | -r] [-b base] name image.png image.h\n");
+				return 1;
+		}
+		name = argv[arg];
+
+		rgb = read_png(argv[arg + 1], &width, &height);
+		if (!rgb) {
+				return 1;
+		}
+		if (width != PAGE_WIDTH) {
+				fprintf(stderr, "mkasset: %s is %d wide, it has to be %d\n", argv[arg + 1], width, PAGE_WIDTH);
+				return 1;
+		}
+
+		/* turn the pixels into palette indices, colors are cut down to the
+		 * 5 bits per channel the hardware has */
+		size = width * height;
+		indices = malloc(size);
+		check = malloc(size);
+		for (i = 0; i < size; i++) {
+				unsigned short color = (rgb[i*3] >> 3) | ((rgb[i*3 + 1] >> 3) << 5) | ((rgb[i*3 + 2] >> 3) << 10);
+				int index;
+				for (index = 0; index < color_count && colors[index] != color; index++) { }
+				if (index == color_count) {
+						if (base + color_count > 255) {
+								fprintf(stderr, "mkasset: %s has too many colors for base %d\n", argv[arg + 1], base);
+								return 1;
+						}
+						colors[color_count++] = color;
+				}
+				indices[i] = base + index;
+		}
+
+		compress_lz77(indices, size, &lz77);
+		compress_rle(indices, size, &rle);
+		if (type == LZ77_TYPE) {
+				best = &lz77;
+		} else if (type == RLE_TYPE) {
+				best = &rle;
+		} else {
+				best = lz77.size <= rle.size ? &lz77 : &rle;
+		}
+
+		if (decompress(best->data, check, size) != size || memcmp(check, indices, size)) {
+				fprintf(stderr, "mkasset: compressed data does not match the image\n");
+				return 1;
+		}
+
+		out = fopen(argv[arg + 2], "w");
+		if (!out) {
+				perror(argv[arg + 2]);
+				return 1;
+		}
+		fprintf(out, "/* generated by tools/mkasset from %s, do not edit */\n", argv[arg + 1]);
+		fprintf(out, "/* %d bytes of pixels, %d bytes %s compressed */\n\n", size, best->size,
+						best->data[0] == LZ77_TYPE ? "lz77" : "run length");
+		fprintf(out, "#define %s_height %d\n", name, height);
+		fprintf(out, "#define %s_color_base %d\n", name, base);
+		fprintf(out, "#define %s_color_count %d\n\n", name, color_count);
+		fprintf(out, "static const unsigned short %s_colors[%d] = {", name, color_count);
+		for (i = 0; i < color_count; i++) {
+				fprintf(out, "%s0x%04x", i ? ", " : "", colors[i]);
+		}
+		fprintf(out, "};\n\n");
+		fprintf(out, "static const unsigned int %s_data[%d] = {", name, best->size / 4);
+		for (i = 0; i < best->size; i += 4) {
+				unsigned int word = best->data[i] | (best->data[i + 1] << 8)
+						| (best->data[i + 2] << 16) | ((unsigned int) best->data[i + 3] << 24);
+				fprintf(out, "%s0x%08x", i == 0 ? "\n\t\t" : i % 32 ? ", " : ",\n\t\t", word);
+		}
+		fprintf(out, "\n};\n");
+		fclose(out);
+
+		printf("%s: %d bytes, lz77 %d, rle %d\n", name, size, lz77.size, rle.size);
+		return 0;
+}
@@ -0,0 +1,90 @@
+/* teldump - turns the gameplay telemetry log into csv
+ *
+ * build it on the host with:
+ *		cc -O2 -o teldump teldump.c
+ *
+ * and run it on either the save file of a cartridge or emulator, or the
+ * file the host build streams events into:
+ *		teldump pong.sav > events.csv
+ *
+ * the layout is written by telemetry_flush and telemetry_record in pong.c */
+#include <stdio.h>
+
+#define TELEMETRY_MAGIC 0x4c455450
+
+/* the kinds of events, in the order of their numbers in pong.c */
+const char* event_names[] = {"unknown", "serve", "paddle_hit", "wall_bounce", "score", "match_end"};
+const char* side_names[] = {"user", "ai"};
+const char* zone_names[] = {"straight", "up", "down", "unknown"};
+
+/* read a little endian word a byte at a time, like the save ram holds it */
+int read_word(FILE* in, unsigned int* word) {
+		unsigned char bytes[4];
+		if (fread(bytes, 1, 4, in) != 4) {
+				return 0;
+		}
+		*word = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int) bytes[3] << 24);
+		return 1;
+}
+
+int main(int argc, char** argv) {
+		FILE* in;
+		unsigned int magic, recorded, kept, event, i;
+		unsigned int frame = 0, last_low = 0;
+
+		if (argc != 2) {
+				fprintf(stderr, "usage: teldump telemetry.bin\n");
+				return 1;
+		}
+		in = fopen(argv[1], "rb");
+		if (!in) {
+				perror(argv[1]);
+				return 1;
+		}
+		if (!read_word(in, &magic) || magic != TELEMETRY_MAGIC
+						|| !read_word(in, &recorded) || !read_word(in, &kept)) {
+				fprintf(stderr, "teldump: %s has no telemetry in it\n", argv[1]);
+				return 1;
+		}
+		if (recorded != 0xffffffff && recorded > kept) {
+				fprintf(stderr, "teldump: the oldest %u events were overwritten\n", recorded - kept);
+		}
+
+		printf("frame,event,side,detail\n");
+		for (i = 0; i < kept && read_word(in, &event); i++) {
+				unsigned int low = event >> 16;
+				unsigned int kind = (event >> 8) & 0xff;
+				unsigned int detail = event & 0xff;
+
+				/* only the low 16 bits of the frame are kept, count the wraps */
+				if (i > 0 && low < last_low) {
+						frame += 0x10000;
+				}
+				last_low = low;
+
+				if (kind >= sizeof(event_names) / sizeof(event_names[0])) {
+						kind = 0;
+				}
+				printf("%u,%s,", (frame & ~0xffffu) | low, event_names[kind]);
+				switch (kind) {
+				case 2:
+						printf("%s,%s\n", side_names[(detail >> 4) & 1], zone_names[detail & 3]);
+						break;
+				case 3:
+						printf(",%s\n", detail ? "bottom" : "top");
+						break;
+				case 4:
+						printf("%s,%u-%u\n", side_names[detail & 1], (detail >> 2) & 7, (detail >> 5) & 7);
+						break;
+				case 5:
+						printf("%s,\n", side_names[detail & 1]);
+						break;
+				default:
+						printf(",\n");
+						break;
+				}
+		}
+
+		fclose(in);
+		return 0;
+}